@@ -7,6 +7,7 @@ namespace audio {
 
 static const std::vector<const char *> supportedTypes = {
 	"wav",
+	"mp3",
 };
 
 bool supported(const String &ext) {
@@ -1,7 +1,10 @@
 /// @file audio.hpp
 #pragma once
 
+#include "audio/engine.hpp"
+#include "audio/loudness.hpp"
 #include "audio/player.hpp"
+#include "audio/transcoder.hpp"
 
 namespace audio {
 
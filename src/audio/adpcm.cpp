@@ -0,0 +1,271 @@
+#include "adpcm.hpp"
+#include <string.h>
+
+namespace audio {
+
+namespace adpcm {
+
+/// The IMA ADPCM quantiser step sizes.
+static const int16_t imaStepTable[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+/// How the IMA ADPCM step index changes after each nibble.
+static const int8_t imaIndexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+/// How the Microsoft ADPCM step size scales after each nibble, in Q8.
+static const int16_t msAdaptationTable[16] = {230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230};
+
+/// The standard Microsoft ADPCM predictor coefficient pairs, in Q8.
+static const int16_t msCoefficients[7][2] = {{256, 0}, {512, -256}, {0, 0}, {192, 64}, {240, 0}, {460, -208}, {392, -232}};
+
+static inline int16_t clamp16(int32_t value) {
+	return value > 32767 ? 32767 : value < -32768 ? -32768 : static_cast<int16_t>(value);
+}
+
+/// The running state of one IMA ADPCM channel.
+struct ImaState {
+	int32_t predictor;
+	int index;
+
+	inline int16_t decode(uint8_t nibble) {
+		const int32_t step = imaStepTable[index];
+
+		// step * (nibble + 0.5) / 4, built from shifts as the reference encoder does.
+		int32_t diff = step >> 3;
+		if (nibble & 4) {
+			diff += step;
+		}
+		if (nibble & 2) {
+			diff += step >> 1;
+		}
+		if (nibble & 1) {
+			diff += step >> 2;
+		}
+
+		predictor = clamp16(nibble & 8 ? predictor - diff : predictor + diff);
+
+		index += imaIndexTable[nibble];
+		index = index < 0 ? 0 : index > 88 ? 88 : index;
+		return static_cast<int16_t>(predictor);
+	}
+};
+
+size_t decodeIma(const uint8_t *block, size_t bytes, unsigned int channels, int16_t *out) {
+	if (bytes < 4 * channels) {
+		return 0;
+	}
+
+	// Each channel's header holds its first sample and initial step index.
+	ImaState state[2];
+	for (unsigned int c = 0; c < channels; c++) {
+		const uint8_t *h = block + c * 4;
+		state[c].predictor = static_cast<int16_t>(h[0] | (h[1] << 8));
+		state[c].index = h[2] > 88 ? 88 : h[2];
+		out[c] = static_cast<int16_t>(state[c].predictor);
+	}
+
+	// The rest is groups of 4 bytes (8 samples) per channel, low nibble first.
+	const uint8_t *data = block + 4 * channels;
+	const size_t groups = (bytes - 4 * channels) / (4 * channels);
+	int16_t *frame = out + channels;
+
+	for (size_t g = 0; g < groups; g++) {
+		for (unsigned int c = 0; c < channels; c++) {
+			for (size_t i = 0; i < 4; i++) {
+				const uint8_t byte = data[i];
+				frame[(i * 2) * channels + c] = state[c].decode(byte & 0x0f);
+				frame[(i * 2 + 1) * channels + c] = state[c].decode(byte >> 4);
+			}
+			data += 4;
+		}
+		frame += 8 * channels;
+	}
+
+	return 1 + groups * 8;
+}
+
+size_t decodeMs(const uint8_t *block, size_t bytes, unsigned int channels, int16_t *out) {
+	if (bytes < 7 * channels) {
+		return 0;
+	}
+
+	// The header is split into fields, each with a value for every channel.
+	int32_t coef1[2], coef2[2], delta[2], sample1[2], sample2[2];
+	const uint8_t *h = block;
+	for (unsigned int c = 0; c < channels; c++) {
+		const uint8_t predictor = h[c] < 7 ? h[c] : 0;
+		coef1[c] = msCoefficients[predictor][0];
+		coef2[c] = msCoefficients[predictor][1];
+	}
+	h += channels;
+	for (unsigned int c = 0; c < channels; c++, h += 2) {
+		delta[c] = static_cast<int16_t>(h[0] | (h[1] << 8));
+	}
+	for (unsigned int c = 0; c < channels; c++, h += 2) {
+		sample1[c] = static_cast<int16_t>(h[0] | (h[1] << 8));
+	}
+	for (unsigned int c = 0; c < channels; c++, h += 2) {
+		sample2[c] = static_cast<int16_t>(h[0] | (h[1] << 8));
+	}
+
+	// The two samples in the header come out oldest first.
+	for (unsigned int c = 0; c < channels; c++) {
+		out[c] = static_cast<int16_t>(sample2[c]);
+		out[channels + c] = static_cast<int16_t>(sample1[c]);
+	}
+
+	// Then nibbles, high nibble first, alternating between channels.
+	const size_t nibbles = (bytes - 7 * channels) * 2;
+	int16_t *sample = out + 2 * channels;
+	unsigned int c = 0;
+
+	for (size_t i = 0; i < nibbles; i++) {
+		const uint8_t byte = h[i >> 1];
+		const uint8_t nibble = i & 1 ? byte & 0x0f : byte >> 4;
+		const int32_t signedNibble = nibble & 8 ? nibble - 16 : nibble;
+
+		const int32_t predicted = (sample1[c] * coef1[c] + sample2[c] * coef2[c]) >> 8;
+		const int16_t value = clamp16(predicted + signedNibble * delta[c]);
+		*sample++ = value;
+
+		sample2[c] = sample1[c];
+		sample1[c] = value;
+		delta[c] = (msAdaptationTable[nibble] * delta[c]) >> 8;
+		if (delta[c] < 16) {
+			delta[c] = 16;
+		}
+
+		if (++c == channels) {
+			c = 0;
+		}
+	}
+
+	return 2 + nibbles / channels;
+}
+
+} // namespace adpcm
+
+AdpcmDecoder::AdpcmDecoder(Source &stream, const wav::header_t &header) : stream(stream), header(header), total(wav::totalFrames(header)), memory(stream.memory()), block(memory ? 0 : header.blockAlign), pcm(header.samplesPerBlock * header.numChannels), pcmStart(0), pcmEnd(0), nextBlock(0), position(0) {
+	wav::seekData(stream, header);
+}
+
+bool AdpcmDecoder::decodeBlock() {
+	// If the length of the data is unknown, blocks are read until the source runs out.
+	const unsigned long offset = static_cast<unsigned long>(nextBlock) * header.blockAlign;
+	if (header.dataSize && offset >= header.dataSize) {
+		return false;
+	}
+
+	unsigned long wanted = header.dataSize ? header.dataSize - offset : header.blockAlign;
+	if (wanted > header.blockAlign) {
+		wanted = header.blockAlign;
+	}
+
+	const uint8_t *data = block.data();
+	size_t count;
+	if (memory) {
+		// Decode the block where it is, rather than copying it out first.
+		const size_t start = header.dataOffset + offset;
+		const size_t left = start < stream.size() ? stream.size() - start : 0;
+		count = wanted < left ? wanted : left;
+		data = memory + start;
+		stream.seek(start + count);
+	} else {
+		count = stream.read(block.data(), wanted);
+		if (count < wanted && stream.buffering()) {
+			// Try this block again once the rest of it has arrived.
+			stream.seek(header.dataOffset + offset);
+			return false;
+		}
+	}
+
+	const size_t frames = header.audioFormat == wav::FORMAT_IMA_ADPCM ? adpcm::decodeIma(data, count, header.numChannels, pcm.data()) : adpcm::decodeMs(data, count, header.numChannels, pcm.data());
+	if (!frames) {
+		return false;
+	}
+
+	pcmStart = 0;
+	pcmEnd = (frames < header.samplesPerBlock ? frames : header.samplesPerBlock) * header.numChannels;
+	nextBlock++;
+	return true;
+}
+
+AudioFormat AdpcmDecoder::format() const {
+	return WAV;
+}
+
+unsigned long AdpcmDecoder::sampleRate() const {
+	return wav::sampleRate(header);
+}
+
+unsigned int AdpcmDecoder::channels() const {
+	return header.numChannels;
+}
+
+unsigned long AdpcmDecoder::frames() const {
+	return total;
+}
+
+size_t AdpcmDecoder::read(int16_t *out, size_t frames) {
+	const unsigned int channels = header.numChannels;
+	size_t count = 0;
+
+	while (count < frames && (!total || position < total)) {
+		if (pcmStart >= pcmEnd && !decodeBlock()) {
+			break;
+		}
+
+		size_t available = (pcmEnd - pcmStart) / channels;
+		if (available > frames - count) {
+			available = frames - count;
+		}
+		if (total && available > total - position) {
+			available = total - position;
+		}
+
+		memcpy(out + count * channels, pcm.data() + pcmStart, available * channels * sizeof(int16_t));
+		pcmStart += available * channels;
+		count += available;
+		position += available;
+	}
+
+	return count;
+}
+
+bool AdpcmDecoder::seek(unsigned long frame) {
+	if (total && frame > total) {
+		frame = total;
+	}
+
+	// Blocks decode independently, so jump straight to the one holding the frame.
+	const unsigned long target = frame / header.samplesPerBlock;
+	if (!stream.seek(header.dataOffset + target * header.blockAlign)) {
+		return false;
+	}
+
+	nextBlock = target;
+	pcmStart = 0;
+	pcmEnd = 0;
+	position = target * header.samplesPerBlock;
+
+	// Decode the block and skip up to the frame.
+	if (frame > position) {
+		if (!decodeBlock()) {
+			return false;
+		}
+		pcmStart = (frame - position) * header.numChannels;
+		position = frame;
+	}
+
+	return true;
+}
+
+} // namespace audio
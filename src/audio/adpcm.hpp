@@ -0,0 +1,74 @@
+/// @file adpcm.hpp
+#pragma once
+
+#include "decoder.hpp"
+#include "header.hpp"
+#include <vector>
+
+namespace audio {
+
+namespace adpcm {
+
+/**
+ * @brief Decode one block of IMA ADPCM data.
+ * @param block The compressed block.
+ * @param bytes The size of the block in bytes. The last block of a file may be shorter than the rest.
+ * @param channels The number of interleaved channels (1 or 2).
+ * @param out The buffer to write signed 16-bit samples to, with channels interleaved.
+ * This must have room for the block's samplesPerBlock frames.
+ * @return The number of frames decoded.
+ */
+size_t decodeIma(const uint8_t *block, size_t bytes, unsigned int channels, int16_t *out);
+
+/**
+ * @brief Decode one block of Microsoft ADPCM data.
+ * @param block The compressed block.
+ * @param bytes The size of the block in bytes. The last block of a file may be shorter than the rest.
+ * @param channels The number of interleaved channels (1 or 2).
+ * @param out The buffer to write signed 16-bit samples to, with channels interleaved.
+ * This must have room for the block's samplesPerBlock frames.
+ * @return The number of frames decoded.
+ */
+size_t decodeMs(const uint8_t *block, size_t bytes, unsigned int channels, int16_t *out);
+
+} // namespace adpcm
+
+/**
+ * @brief A decoder for IMA and Microsoft ADPCM compressed WAV files.
+ *
+ * ADPCM stores each sample as a 4-bit step relative to a prediction, so files are a quarter the size of 16-bit PCM.
+ * Audio is stored in fixed-size blocks that can each be decoded on their own, so
+ * one block is read and decoded at a time, and seeking is just a jump to the right block.
+ */
+class AdpcmDecoder : public Decoder {
+	Source &stream;
+	wav::header_t header;
+	unsigned long total;
+	const uint8_t *memory;
+
+	std::vector<uint8_t> block;
+	std::vector<int16_t> pcm;
+	size_t pcmStart;
+	size_t pcmEnd;
+	unsigned long nextBlock;
+	unsigned long position;
+
+	bool decodeBlock();
+
+public:
+	/**
+	 * @brief Constructor for the AdpcmDecoder class.
+	 * @param stream The source to decode.
+	 * @param header The parsed WAV header.
+	 */
+	AdpcmDecoder(Source &stream, const wav::header_t &header);
+
+	AudioFormat format() const override;
+	unsigned long sampleRate() const override;
+	unsigned int channels() const override;
+	unsigned long frames() const override;
+	size_t read(int16_t *out, size_t frames) override;
+	bool seek(unsigned long frame) override;
+};
+
+} // namespace audio
@@ -0,0 +1,146 @@
+#include "dac.hpp"
+#include "../logger.hpp"
+#include "sink.hpp"
+#include "telemetry.hpp"
+#include <Arduino.h>
+
+#ifdef EMULATE
+#warning "Audio playback not supported when emulating. No sound will be produced!"
+#endif
+
+namespace audio {
+
+namespace dac {
+
+#ifndef EMULATE
+static DacSink defaultSink;
+#else
+static NullSink defaultSink;
+#endif
+
+static Sink *sink = &defaultSink;
+static bool started = false;
+static Gain outputGain;
+
+/* There's no way to ask the DAC how full its queue is, so it's modelled from the time between writes instead.
+ * The DAC's clock won't exactly match micros(), so the model is re-synced whenever the DAC reports it's full. */
+static bool running = false;
+static bool filled = false;
+static bool full = false;
+static size_t queued = 0;
+static unsigned long lastWrite = 0;
+static uint64_t elapsed = 0;
+
+/// Update the queue model for the time since the last write, and count an underrun if it ran dry.
+static void drain() {
+	const unsigned long now = micros();
+
+	if (!running) {
+		running = true;
+		filled = false;
+		full = false;
+		queued = 0;
+		elapsed = 0;
+		lastWrite = now;
+		return;
+	}
+
+	// Count time in units of samples * microseconds, so that no rounding error builds up.
+	elapsed += static_cast<uint64_t>(now - lastWrite) * AUDIO_OUTPUT_RATE;
+	lastWrite = now;
+
+	const uint64_t bufferTime = static_cast<uint64_t>(BUFFER_SIZE) * 1000000;
+	const uint64_t played = elapsed / bufferTime;
+	elapsed %= bufferTime;
+
+	if (played > queued) {
+		// Only trust the model's underrun if the sink agrees, if it can tell.
+		if (sink->empty()) {
+			telemetry::underrun();
+		}
+		queued = 0;
+		elapsed = 0;
+	} else {
+		queued -= played;
+	}
+}
+
+void setSink(Sink *sink) {
+	dac::sink = sink ? sink : &defaultSink;
+	started = false;
+	running = false;
+}
+
+bool begin() {
+	if (started) {
+		return true;
+	}
+
+	if (!sink->begin()) {
+		return false;
+	}
+
+	started = true;
+	return true;
+}
+
+bool available() {
+	if (!started) {
+		return false;
+	}
+
+	const bool ready = sink->available();
+	if (!ready) {
+		full = true;
+	}
+	return ready;
+}
+
+void idle() {
+	running = false;
+}
+
+Gain &gain() {
+	return outputGain;
+}
+
+void write(const int16_t *samples) {
+	drain();
+
+	int32_t increment;
+	int32_t level = outputGain.next(BUFFER_SIZE, increment);
+	uint16_t *buf = sink->acquire();
+
+	for (size_t i = 0; i < BUFFER_SIZE; i++) {
+		// Apply the gain and scale down to 12 bit in one step.
+		// The level drops to 12 fractional bits so the product fits in 32 bits, then 4 more bits come off the sample.
+		int32_t y = (static_cast<int32_t>(samples[i]) * (level >> (Gain::FRACTION_BITS - 12))) >> 16;
+		if (y > 2047) {
+			y = 2047;
+		} else if (y < -2048) {
+			y = -2048;
+		}
+
+		buf[i] = y + 2048;
+		level += increment;
+	}
+
+	sink->commit();
+
+	// If the DAC was full before this write, one buffer has been played since, and this one took its place.
+	if (full) {
+		queued = QUEUE_DEPTH;
+		elapsed = 0;
+		full = false;
+	} else if (queued < QUEUE_DEPTH) {
+		queued++;
+	}
+	if (queued == QUEUE_DEPTH) {
+		filled = true;
+	}
+	telemetry::queued(queued, filled);
+}
+
+} // namespace dac
+
+} // namespace audio
@@ -0,0 +1,68 @@
+/// @file dac.hpp
+#pragma once
+
+#include "gain.hpp"
+#include <stddef.h>
+#include <stdint.h>
+
+/// The sample rate that the DAC runs at. All audio is resampled to this rate.
+#ifndef AUDIO_OUTPUT_RATE
+#define AUDIO_OUTPUT_RATE 44100
+#endif
+
+namespace audio {
+
+class Sink;
+
+namespace dac {
+
+/// The number of samples in each buffer sent to the DAC.
+constexpr size_t BUFFER_SIZE = 256;
+
+/// The number of buffers the DAC queues up for playback.
+constexpr size_t QUEUE_DEPTH = 16;
+
+/**
+ * @brief Choose where audio buffers go once they've been converted.
+ * By default this is the DAC, or a real-time NullSink when emulating.
+ * @param sink The sink to output to. This must outlive its use, and is not deleted.
+ * If nullptr, the default sink is used again.
+ * @note The new sink is started with the next call to begin().
+ */
+void setSink(Sink *sink);
+
+/**
+ * @brief Start the DAC (or the current sink) at AUDIO_OUTPUT_RATE.
+ * The DAC stays running once started, so this is safe to call for every track.
+ * @return True if the DAC is running, false otherwise.
+ */
+bool begin();
+
+/**
+ * @brief Check if the DAC is ready to accept another buffer.
+ * @return True if a buffer can be written, false otherwise.
+ */
+bool available();
+
+/**
+ * @brief Let the DAC know that no audio is coming for a while (e.g. paused, or the end of the queue),
+ * so that the gap before the next write isn't counted as an underrun.
+ */
+void idle();
+
+/**
+ * @brief Get the gain stage applied to everything written to the DAC.
+ * @return The output gain, for setting the volume and ReplayGain.
+ */
+Gain &gain();
+
+/**
+ * @brief Write a buffer of samples to the DAC, applying the output gain and scaling them down to 12 bit.
+ * @param samples Exactly BUFFER_SIZE signed 16-bit mono samples.
+ * @note Only call this when available() returns true.
+ */
+void write(const int16_t *samples);
+
+} // namespace dac
+
+} // namespace audio
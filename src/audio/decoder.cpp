@@ -0,0 +1,60 @@
+#include "decoder.hpp"
+#include "adpcm.hpp"
+#include "mp3.hpp"
+
+namespace audio {
+
+Decoder *Decoder::open(Source &stream) {
+	wav::header_t wavHeader;
+	if (wav::parse(stream, wavHeader)) {
+		if (!wav::valid(wavHeader)) {
+			logger::error("Unsupported WAV encoding.");
+			return nullptr;
+		}
+		if (wav::compressed(wavHeader)) {
+			return new AdpcmDecoder(stream, wavHeader);
+		}
+		return new WavDecoder(stream, wavHeader);
+	}
+
+	mp3::header_t mp3Header;
+	if (mp3::parse(stream, mp3Header)) {
+		return new Mp3Decoder(stream, mp3Header);
+	}
+
+	return nullptr;
+}
+
+WavDecoder::WavDecoder(Source &stream, const wav::header_t &header) : stream(stream), header(header), position(0) {
+	wav::seekData(stream, header);
+}
+
+AudioFormat WavDecoder::format() const {
+	return WAV;
+}
+
+unsigned long WavDecoder::sampleRate() const {
+	return wav::sampleRate(header);
+}
+
+unsigned int WavDecoder::channels() const {
+	return header.numChannels;
+}
+
+unsigned long WavDecoder::frames() const {
+	return wav::totalFrames(header);
+}
+
+size_t WavDecoder::read(int16_t *out, size_t frames) {
+	return wav::getChunk(stream, header, position, out, frames);
+}
+
+bool WavDecoder::seek(unsigned long frame) {
+	if (!wav::seekFrame(stream, header, frame)) {
+		return false;
+	}
+	position = frame;
+	return true;
+}
+
+} // namespace audio
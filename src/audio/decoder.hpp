@@ -0,0 +1,89 @@
+/// @file decoder.hpp
+#pragma once
+
+#include "source.hpp"
+#include "header.hpp"
+
+namespace audio {
+
+/**
+ * @brief A base class for decoding audio into raw signal data.
+ * Each supported audio format has its own subclass, which keeps whatever state that format needs between chunks.
+ */
+class Decoder {
+public:
+	/// Destructor.
+	virtual ~Decoder() {}
+
+	/**
+	 * @brief Detect the format of an audio file and create a decoder for it.
+	 * @param stream The source to decode. This must outlive the decoder.
+	 * @return A new decoder positioned at the start of the audio, or nullptr if the format is not supported.
+	 */
+	static Decoder *open(Source &stream);
+
+	/**
+	 * @brief Get the audio format being decoded.
+	 * @return The audio format.
+	 */
+	virtual AudioFormat format() const = 0;
+
+	/**
+	 * @brief Get the sample rate of the audio.
+	 * @return The sample rate in Hz.
+	 */
+	virtual unsigned long sampleRate() const = 0;
+
+	/**
+	 * @brief Get the number of channels in the audio.
+	 * @return The number of interleaved channels.
+	 */
+	virtual unsigned int channels() const = 0;
+
+	/**
+	 * @brief Get the length of the audio.
+	 * @return The total number of frames, where a frame is one sample for every channel, or 0 if the length is unknown.
+	 */
+	virtual unsigned long frames() const = 0;
+
+	/**
+	 * @brief Decode the next chunk of audio.
+	 * @param out The buffer to write signed 16-bit samples to, with channels interleaved.
+	 * @param frames The maximum number of frames to decode.
+	 * @return The number of frames decoded. This is 0 once the end of the audio is reached.
+	 */
+	virtual size_t read(int16_t *out, size_t frames) = 0;
+
+	/**
+	 * @brief Seek to a specific frame of the audio.
+	 * @param frame The frame to seek to.
+	 * @return True if the seek was successful, false otherwise.
+	 */
+	virtual bool seek(unsigned long frame) = 0;
+};
+
+/**
+ * @brief A decoder for PCM WAV files.
+ */
+class WavDecoder : public Decoder {
+	Source &stream;
+	wav::header_t header;
+	unsigned long position;
+
+public:
+	/**
+	 * @brief Constructor for the WavDecoder class.
+	 * @param stream The source to decode.
+	 * @param header The parsed WAV header.
+	 */
+	WavDecoder(Source &stream, const wav::header_t &header);
+
+	AudioFormat format() const override;
+	unsigned long sampleRate() const override;
+	unsigned int channels() const override;
+	unsigned long frames() const override;
+	size_t read(int16_t *out, size_t frames) override;
+	bool seek(unsigned long frame) override;
+};
+
+} // namespace audio
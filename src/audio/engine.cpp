@@ -0,0 +1,242 @@
+#include "engine.hpp"
+#include "dac.hpp"
+#include "telemetry.hpp"
+#include <math.h>
+#include <string.h>
+
+/// The number of steps in the crossfade gain curve. Gains between steps are interpolated.
+#define CROSSFADE_STEPS 256
+
+namespace audio {
+
+/// An equal-power gain curve, sin(0..pi/2) in Q15. Fading out uses the curve backwards.
+static uint16_t crossfadeCurve[CROSSFADE_STEPS + 1];
+
+/// The time it takes the DAC to play one buffer, in microseconds.
+static const unsigned long bufferMicros = 1000000UL * dac::BUFFER_SIZE / AUDIO_OUTPUT_RATE;
+
+Engine::Engine() : current(nullptr), next(nullptr), playing(false), crossfadeSamples(0), fading(false), fadePosition(0), fadeLength(0), busyMicros(0), fadeBusyMicros(0), fadePeakMicros(0), fadeBuffers(0) {
+	if (!crossfadeCurve[CROSSFADE_STEPS]) {
+		for (int i = 0; i <= CROSSFADE_STEPS; i++) {
+			crossfadeCurve[i] = static_cast<uint16_t>(lroundf(sinf(static_cast<float>(M_PI_2) * i / CROSSFADE_STEPS) * 32768.0f));
+		}
+	}
+}
+
+Engine::~Engine() {
+	clear();
+}
+
+Player *Engine::open() {
+	// Skip over anything that can't be played.
+	while (!queue.empty()) {
+		auto player = new Player(queue.front().file);
+		player->setReplayGain(queue.front().replayGain);
+		queue.erase(queue.begin());
+
+		if (player->good()) {
+			player->prime();
+			return player;
+		}
+
+		delete player;
+	}
+
+	return nullptr;
+}
+
+void Engine::advance() {
+	// Only take a track that process() has already opened, since opening one here would hold up the audio.
+	delete current;
+	current = next;
+	next = nullptr;
+	fading = false;
+}
+
+size_t Engine::crossfade(int16_t *buf) {
+	int16_t mix[dac::BUFFER_SIZE];
+	const size_t count = current->read(buf, dac::BUFFER_SIZE);
+	const size_t mixed = next->read(mix, dac::BUFFER_SIZE);
+
+	// Step through the gain curve in Q16.
+	const uint64_t curveLength = static_cast<uint64_t>(CROSSFADE_STEPS) << 16;
+	uint64_t curvePosition = curveLength * fadePosition / fadeLength;
+	const uint64_t curveStep = curveLength / fadeLength;
+
+	for (size_t i = 0; i < dac::BUFFER_SIZE; i++) {
+		int32_t fadeIn = 32768;
+		int32_t fadeOut = 0;
+		if (curvePosition < curveLength) {
+			// Equal power: the gains of the two tracks are sin and cos of the same angle.
+			// Interpolate between steps of the curve.
+			const size_t step = curvePosition >> 16;
+			const size_t reverse = CROSSFADE_STEPS - step;
+			const int32_t frac = (curvePosition >> 1) & 0x7fff;
+			fadeIn = crossfadeCurve[step] + (((crossfadeCurve[step + 1] - crossfadeCurve[step]) * frac) >> 15);
+			fadeOut = crossfadeCurve[reverse] + (((crossfadeCurve[reverse - 1] - crossfadeCurve[reverse]) * frac) >> 15);
+			curvePosition += curveStep;
+		}
+
+		const int32_t a = i < count ? buf[i] : 0;
+		const int32_t b = i < mixed ? mix[i] : 0;
+		int32_t y = (a * fadeOut + b * fadeIn) >> 15;
+
+		if (y > 32767) {
+			y = 32767;
+		} else if (y < -32768) {
+			y = -32768;
+		}
+		buf[i] = static_cast<int16_t>(y);
+	}
+
+	fadePosition += dac::BUFFER_SIZE;
+
+	// Once the outgoing track runs out, the incoming track carries on alone.
+	if (count < dac::BUFFER_SIZE && !current->buffering()) {
+		delete current;
+		current = next;
+		next = nullptr;
+		fading = false;
+
+		logger::info("Crossfade used " + String(100.0f * fadeBusyMicros / (fadeBuffers ? fadeBuffers : 1) / bufferMicros, 1) + "% of real time on average (" + String(100.0f * fadePeakMicros / bufferMicros, 1) + "% peak).");
+	}
+
+	return count > mixed ? count : mixed;
+}
+
+void Engine::enqueue(const fs::Path &file, const ReplayGain &replayGain) {
+	queue.push_back(Track{file, replayGain});
+}
+
+void Engine::clear() {
+	delete current;
+	delete next;
+	current = nullptr;
+	next = nullptr;
+	fading = false;
+	queue.clear();
+}
+
+void Engine::skip() {
+	advance();
+}
+
+void Engine::process() {
+	if (!current) {
+		current = open();
+	}
+
+	if (current && !next) {
+		next = open();
+	}
+
+	if (current) {
+		current->prefetch();
+	}
+}
+
+bool Engine::output() {
+	if (!playing || !dac::available()) {
+		return false;
+	}
+
+	if (!current) {
+		advance();
+		if (!current) {
+			// Nothing to play until process() opens the next track, if there is one.
+			dac::idle();
+			return false;
+		}
+	}
+
+	const unsigned long start = micros();
+
+	// Start fading into the next track once the current one is within the crossfade length of its end.
+	if (crossfadeSamples && next && !fading && current->remaining() <= crossfadeSamples) {
+		fading = true;
+		fadePosition = 0;
+		fadeLength = current->remaining() ? current->remaining() : 1;
+		fadeBusyMicros = 0;
+		fadePeakMicros = 0;
+		fadeBuffers = 0;
+	}
+
+	int16_t buf[dac::BUFFER_SIZE];
+	const bool wasFading = fading;
+	size_t count = fading ? crossfade(buf) : current->read(buf, dac::BUFFER_SIZE);
+
+	// The current track ended partway through this buffer, so continue straight into the next one.
+	// If it's only waiting on a download though, fill the gap with silence instead.
+	while (count < dac::BUFFER_SIZE && !current->buffering()) {
+		advance();
+		if (!current) {
+			break;
+		}
+		count += current->read(buf + count, dac::BUFFER_SIZE - count);
+	}
+
+	if (!count && !current) {
+		dac::idle();
+		return false;
+	}
+
+	if (current && current->buffering()) {
+		telemetry::stall();
+	}
+
+	// Pad out the very last buffer, or a gap while buffering, with silence.
+	memset(buf + count, 0, (dac::BUFFER_SIZE - count) * sizeof(int16_t));
+
+	// The gain ramps between tracks, so a change of ReplayGain at a splice or crossfade doesn't click.
+	if (current) {
+		dac::gain().setReplayGain(current->getReplayGain());
+	}
+	dac::write(buf);
+	if (!current) {
+		dac::idle(); // That was the end of the queue, or the next track hasn't been opened by process() yet.
+	}
+
+	const unsigned long elapsed = micros() - start;
+	telemetry::refilled(elapsed);
+	busyMicros = (busyMicros * 7 + elapsed) / 8;
+	if (wasFading) {
+		fadeBusyMicros += elapsed;
+		fadeBuffers++;
+		if (elapsed > fadePeakMicros) {
+			fadePeakMicros = elapsed;
+		}
+	}
+
+	return true;
+}
+
+void Engine::play() {
+	playing = true;
+}
+
+void Engine::pause() {
+	playing = false;
+	dac::idle();
+}
+
+void Engine::setCrossfade(float seconds) {
+	crossfadeSamples = seconds > 0.0f ? static_cast<unsigned long>(seconds * AUDIO_OUTPUT_RATE) : 0;
+}
+
+void Engine::setVolume(float volume) {
+	dac::gain().setVolume(volume);
+}
+
+float Engine::load() const {
+	return static_cast<float>(busyMicros) / bufferMicros;
+}
+
+bool Engine::finished() const {
+	return !current && !next && queue.empty();
+}
+
+Player *Engine::player() {
+	return current;
+}
+
+} // namespace audio
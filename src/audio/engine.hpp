@@ -0,0 +1,133 @@
+/// @file engine.hpp
+#pragma once
+
+#include "player.hpp"
+
+namespace audio {
+
+/**
+ * @brief A class to play a queue of audio files back to back without gaps.
+ *
+ * While one track is playing, the next track in the queue is opened and its first
+ * block is decoded ahead of time. When the current track runs out partway through a DAC buffer,
+ * the rest of that buffer is filled from the next track, so tracks are spliced together
+ * on the exact sample boundary and the DAC is never stopped or reconfigured.
+ *
+ * Optionally, consecutive tracks can be crossfaded instead. The tail of the current track
+ * is mixed with the head of the next one using an equal-power curve, so both tracks are decoded
+ * at the same time for the length of the fade.
+ */
+class Engine {
+	/// A track waiting in the queue.
+	struct Track {
+		fs::Path file;
+		ReplayGain replayGain;
+	};
+
+	Player *current;
+	Player *next;
+	std::vector<Track> queue;
+	bool playing;
+
+	unsigned long crossfadeSamples;
+	bool fading;
+	unsigned long fadePosition;
+	unsigned long fadeLength;
+
+	unsigned long busyMicros;
+	unsigned long fadeBusyMicros;
+	unsigned long fadePeakMicros;
+	unsigned long fadeBuffers;
+
+	Player *open();
+	void advance();
+	size_t crossfade(int16_t *buf);
+
+public:
+	/// Constructor.
+	Engine();
+
+	/// Destructor.
+	~Engine();
+
+	Engine(const Engine &) = delete;
+	Engine &operator=(const Engine &) = delete;
+
+	/**
+	 * @brief Add an audio file to the end of the play queue.
+	 * @param file The file path to the audio file to play.
+	 * @param replayGain The ReplayGain of the track, if known.
+	 */
+	void enqueue(const fs::Path &file, const ReplayGain &replayGain = {0.0f, 0.0f});
+
+	/**
+	 * @brief Stop playback and remove every track from the queue.
+	 */
+	void clear();
+
+	/**
+	 * @brief Skip to the next track in the queue.
+	 */
+	void skip();
+
+	/**
+	 * @brief Open the next track ahead of time if it hasn't been already, and read ahead in the current one.
+	 * @note This should be called regularly from the main loop, so that opening and reading files
+	 * never happens while the audio device is waiting for data.
+	 */
+	void process();
+
+	/**
+	 * @brief Output the audio data to the audio device.
+	 * This never opens a track itself. If the next one hasn't been opened by process() yet, the current one is followed
+	 * by silence until it has.
+	 * @return True if the output was successful, false otherwise (paused, waiting on the device or process(), or the queue is finished).
+	 */
+	bool output();
+
+	/**
+	 * @brief Play or continue the queue.
+	 */
+	void play();
+
+	/**
+	 * @brief Pause playback until resumed.
+	 */
+	void pause();
+
+	/**
+	 * @brief Set how long consecutive tracks should be crossfaded for.
+	 * @param seconds The length of the crossfade in seconds. If 0, tracks are played gaplessly instead.
+	 * @note Tracks are only crossfaded if the next track has been opened by process() before the fade would start.
+	 */
+	void setCrossfade(float seconds);
+
+	/**
+	 * @brief Set the output volume.
+	 * Changes are ramped in smoothly rather than applied instantly.
+	 * @param volume The volume, from 0.0 (silent) to 1.0 (full).
+	 */
+	void setVolume(float volume);
+
+	/**
+	 * @brief Get the fraction of real time spent producing audio.
+	 * This is a smoothed average of the time taken by output(), relative to the time it takes the DAC to play one buffer.
+	 * During a crossfade it includes decoding both tracks, so it shows how much headroom is left for everything else.
+	 * @return The audio load, where 1.0 means the audio path uses all available CPU time.
+	 */
+	float load() const;
+
+	/**
+	 * @brief Check if every track in the queue has finished playing.
+	 * @return True if there is nothing left to play, false otherwise.
+	 */
+	bool finished() const;
+
+	/**
+	 * @brief Get the player for the track that is currently playing.
+	 * @return The current player, or nullptr if nothing is playing.
+	 */
+	Player *player();
+};
+
+} // namespace audio
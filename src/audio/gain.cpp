@@ -0,0 +1,68 @@
+#include "gain.hpp"
+#include <math.h>
+
+/// The number of samples it takes the gain to ramp to a new level (about 50ms).
+#define GAIN_RAMP_SAMPLES 2048
+
+namespace audio {
+
+constexpr unsigned int Gain::FRACTION_BITS;
+constexpr int32_t Gain::UNITY;
+constexpr int32_t Gain::MAX;
+
+Gain::Gain() : level(UNITY), target(UNITY), step(0), volume(1.0f), replayGain{0.0f, 0.0f} {}
+
+void Gain::update() {
+	float trackGain = powf(10.0f, replayGain.gain / 20.0f);
+
+	// Don't let ReplayGain push the loudest sample of the track past full scale.
+	if (replayGain.peak > 0.0f && trackGain * replayGain.peak > 1.0f) {
+		trackGain = 1.0f / replayGain.peak;
+	}
+
+	const float scaled = volume * volume * trackGain * UNITY;
+	target = scaled > MAX ? MAX : static_cast<int32_t>(scaled);
+
+	step = (target - level) / GAIN_RAMP_SAMPLES;
+	if (!step && target != level) {
+		step = target > level ? 1 : -1;
+	}
+}
+
+void Gain::setVolume(float volume) {
+	if (volume < 0.0f) {
+		volume = 0.0f;
+	} else if (volume > 1.0f) {
+		volume = 1.0f;
+	}
+
+	if (volume != this->volume) {
+		this->volume = volume;
+		update();
+	}
+}
+
+float Gain::getVolume() const {
+	return volume;
+}
+
+void Gain::setReplayGain(const ReplayGain &replayGain) {
+	if (replayGain.gain != this->replayGain.gain || replayGain.peak != this->replayGain.peak) {
+		this->replayGain = replayGain;
+		update();
+	}
+}
+
+int32_t Gain::next(size_t count, int32_t &increment) {
+	const int32_t start = level;
+
+	if (level != target) {
+		const int64_t end = level + static_cast<int64_t>(step) * count;
+		level = (step > 0 && end > target) || (step < 0 && end < target) ? target : static_cast<int32_t>(end);
+	}
+
+	increment = (level - start) / static_cast<int32_t>(count);
+	return start;
+}
+
+} // namespace audio
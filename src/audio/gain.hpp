@@ -0,0 +1,79 @@
+/// @file gain.hpp
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace audio {
+
+/**
+ * @brief Per-track loudness normalisation, as found in ReplayGain tags.
+ */
+struct ReplayGain {
+	/// The gain to apply, in dB. Positive values make the track louder.
+	float gain;
+	/// The peak sample amplitude of the track, where 1.0 is full scale, or 0 if unknown.
+	float peak;
+};
+
+/**
+ * @brief A fixed-point output gain stage, combining the volume and the ReplayGain of the playing track.
+ *
+ * Changes to the gain don't take effect instantly, which would cause audible clicks ("zipper noise").
+ * Instead the gain ramps linearly towards its new target over GAIN_RAMP_SAMPLES samples.
+ *
+ * The gain is applied by the DAC as it converts samples down to 12 bit, so it doesn't cost an extra pass over each buffer.
+ */
+class Gain {
+public:
+	/// The number of fractional bits in the gain level.
+	static constexpr unsigned int FRACTION_BITS = 20;
+	/// A gain level of 1.0 (0 dB).
+	static constexpr int32_t UNITY = 1 << FRACTION_BITS;
+	/// The highest gain level allowed, +12 dB. This keeps the sample multiply within 32 bits.
+	static constexpr int32_t MAX = UNITY * 4;
+
+private:
+	int32_t level;
+	int32_t target;
+	int32_t step;
+	float volume;
+	ReplayGain replayGain;
+
+	/// Recalculate the target level after the volume or ReplayGain changes.
+	void update();
+
+public:
+	/// Constructor. The gain starts at full volume, with no ReplayGain.
+	Gain();
+
+	/**
+	 * @brief Set the output volume.
+	 * @param volume The volume, from 0.0 (silent) to 1.0 (full).
+	 * This is squared to get the amplitude, so that steps in volume sound roughly even.
+	 */
+	void setVolume(float volume);
+
+	/**
+	 * @brief Get the output volume.
+	 * @return The volume, from 0.0 (silent) to 1.0 (full).
+	 */
+	float getVolume() const;
+
+	/**
+	 * @brief Set the ReplayGain of the track that's playing.
+	 * The gain is reduced if needed so that the track's peak won't clip.
+	 * @param replayGain The ReplayGain of the track. Use a gain of 0 dB to disable.
+	 */
+	void setReplayGain(const ReplayGain &replayGain);
+
+	/**
+	 * @brief Step the gain along its ramp for the next buffer.
+	 * @param count The number of samples in the buffer.
+	 * @param increment Set to the amount to add to the level after each sample.
+	 * @return The level for the first sample in the buffer, with FRACTION_BITS fractional bits.
+	 */
+	int32_t next(size_t count, int32_t &increment);
+};
+
+} // namespace audio
@@ -1,57 +1,267 @@
 #include "header.hpp"
+#include <string.h>
+
+// The size of the stack buffer used to convert 8 and 24-bit samples.
+#define WAV_CONVERT_BUFFER 768
 
 namespace audio {
 
 namespace wav {
 
-bool valid(const header_t &header) {
-	return (*(unsigned int *)header.chunkID == 0x46464952) && (*(unsigned int *)header.format == 0x45564157);
+/// Read a little-endian 16-bit value from a byte buffer.
+static inline unsigned short le16(const uint8_t *data) {
+	return data[0] | (data[1] << 8);
 }
 
-void seekData(fs::FileStream &stream) {
-	stream.seek(44); // Skip the header to the data chunk
+/// Write a little-endian value to a byte buffer.
+static void put(uint8_t *data, uint32_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		data[i] = (value >> (i * 8)) & 0xff;
+	}
 }
 
-unsigned long sampleRate(const header_t &header) {
-	return header.sampleRate;
+/// Read a little-endian 32-bit value from a byte buffer.
+static inline unsigned long le32(const uint8_t *data) {
+	return static_cast<unsigned long>(data[0]) | (static_cast<unsigned long>(data[1]) << 8) | (static_cast<unsigned long>(data[2]) << 16) | (static_cast<unsigned long>(data[3]) << 24);
 }
 
-} // namespace wav
+bool compressed(const header_t &header) {
+	return header.audioFormat == FORMAT_IMA_ADPCM || header.audioFormat == FORMAT_MS_ADPCM;
+}
 
-header_t::header_t() {}
+/// Get the number of frames in an ADPCM block of a given size.
+static unsigned long blockFrames(const header_t &header, unsigned long bytes) {
+	const unsigned long channels = header.numChannels;
 
-bool validHeader(const header_t &header) {
-	return wav::valid(header.wav);
+	// Each block starts with a header per channel holding the first sample(s), followed by 4-bit samples.
+	// IMA packs those in groups of 4 bytes (8 samples) per channel, MS simply alternates channels every nibble.
+	if (header.audioFormat == FORMAT_IMA_ADPCM) {
+		return bytes >= 4 * channels ? 1 + (bytes - 4 * channels) / (4 * channels) * 8 : 0;
+	}
+	return bytes >= 7 * channels ? 2 + (bytes - 7 * channels) * 2 / channels : 0;
 }
 
-std::vector<uint16_t> getChunk(fs::FileStream &stream, int chunkSize, AudioFormat format) {
-	if (format == WAV) {
-		/* Read the data chunk. */
-		return stream.read<uint16_t>(chunkSize);
-	} else {
-		logger::error("Unsupported audio format for chunk reading.");
-		return {};
+bool valid(const header_t &header) {
+	if (header.numChannels < 1 || header.numChannels > 2) {
+		return false;
+	}
+
+	if (compressed(header)) {
+		return header.sampleRate > 0 && header.bitsPerSample == 4 && header.samplesPerBlock > 0 && header.samplesPerBlock == blockFrames(header, header.blockAlign);
+	}
+
+	if (header.audioFormat != FORMAT_PCM) {
+		return false;
+	}
+
+	if (header.bitsPerSample != 8 && header.bitsPerSample != 16 && header.bitsPerSample != 24) {
+		return false;
 	}
+
+	return header.sampleRate > 0 && header.byteRate > 0 && header.blockAlign == header.numChannels * (header.bitsPerSample / 8);
 }
 
-float getCurrentSeconds(const fs::FileStream &stream, const header_t &header, AudioFormat format) {
-	if (format == WAV) {
-		unsigned long position = stream.tell() - 44;
-		return static_cast<float>(position) / header.wav.byteRate;
-	} else {
-		logger::error("Unsupported audio format for current seconds calculation.");
-		return 0.0f;
+bool parse(Source &stream, header_t &header) {
+	header = {};
+
+	if (!stream.seek(0)) {
+		return false;
+	}
+
+	// RIFF header: "RIFF", <riff size>, "WAVE"
+	uint8_t riff[12];
+	if (stream.read(riff, sizeof(riff)) < sizeof(riff) || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+		return false;
 	}
+
+	unsigned long offset = 12;
+	bool foundFormat = false;
+	bool foundData = false;
+
+	while (!(foundFormat && foundData)) {
+		uint8_t chunkHeader[8];
+		if (stream.read(chunkHeader, sizeof(chunkHeader)) < sizeof(chunkHeader)) {
+			break; // Ran out of chunks
+		}
+
+		const unsigned long chunkSize = le32(chunkHeader + 4);
+		offset += 8;
+
+		if (memcmp(chunkHeader, "fmt ", 4) == 0) {
+			// Only the first 40 bytes matter, even for WAVE_FORMAT_EXTENSIBLE.
+			// The MS ADPCM coefficient table comes after that, but it's always the standard one.
+			uint8_t fmt[40];
+			const size_t fmtSize = stream.read(fmt, chunkSize < sizeof(fmt) ? chunkSize : sizeof(fmt));
+			if (fmtSize < 16) {
+				return false;
+			}
+
+			header.audioFormat = le16(fmt);
+			header.numChannels = le16(fmt + 2);
+			header.sampleRate = le32(fmt + 4);
+			header.byteRate = le32(fmt + 8);
+			header.blockAlign = le16(fmt + 12);
+			header.bitsPerSample = le16(fmt + 14);
+
+			// The real format code is the first two bytes of the sub-format GUID.
+			if (header.audioFormat == FORMAT_EXTENSIBLE && fmtSize >= 26) {
+				header.audioFormat = le16(fmt + 24);
+			}
+
+			// ADPCM formats have the number of frames per block in the extension, or it can be worked out from the block size.
+			if (compressed(header)) {
+				header.samplesPerBlock = fmtSize >= 20 ? le16(fmt + 18) : blockFrames(header, header.blockAlign);
+			}
+
+			foundFormat = true;
+		} else if (memcmp(chunkHeader, "data", 4) == 0) {
+			header.dataOffset = offset;
+			header.dataSize = chunkSize;
+
+			// Files written by streaming encoders may not know the data length up front.
+			// Nor may the source, e.g. a chunked download, in which case the data runs to the end of the file.
+			if (chunkSize == 0 || chunkSize == 0xFFFFFFFF) {
+				header.dataSize = stream.size() > offset ? stream.size() - offset : 0;
+			}
+
+			foundData = true;
+		} else if (memcmp(chunkHeader, "fact", 4) == 0) {
+			// The exact length of compressed audio, since the last block may be padded.
+			uint8_t fact[4];
+			if (stream.read(fact, sizeof(fact)) == sizeof(fact)) {
+				header.factFrames = le32(fact);
+			}
+		}
+
+		// Chunks are always padded to an even number of bytes.
+		offset += chunkSize + (chunkSize & 1);
+		if (!(foundFormat && foundData) && !stream.seek(offset)) {
+			break;
+		}
+	}
+
+	return foundFormat && foundData;
+}
+
+void seekData(Source &stream, const header_t &header) {
+	stream.seek(header.dataOffset);
+}
+
+unsigned long sampleRate(const header_t &header) {
+	return header.sampleRate;
 }
 
-float getTotalSeconds(const fs::FileStream &stream, const header_t &header, AudioFormat format) {
-	if (format == WAV) {
-		unsigned long totalSize = stream.size() - 44;
-		return static_cast<float>(totalSize) / header.wav.byteRate;
+unsigned long totalFrames(const header_t &header) {
+	if (compressed(header)) {
+		// The fact chunk still gives the length when the data chunk doesn't.
+		if (!header.dataSize) {
+			return header.factFrames;
+		}
+		const unsigned long frames = header.dataSize / header.blockAlign * header.samplesPerBlock + blockFrames(header, header.dataSize % header.blockAlign);
+		return header.factFrames && header.factFrames < frames ? header.factFrames : frames;
+	}
+	return header.dataSize / header.blockAlign;
+}
+
+size_t getChunk(Source &stream, const header_t &header, unsigned long &frame, int16_t *out, size_t frames) {
+	const unsigned int bytesPerSample = header.bitsPerSample / 8;
+
+	/* Never read past the data chunk, or trailing chunks would play as noise. If its length is unknown, read to the end. */
+	const unsigned long total = totalFrames(header);
+	if (header.dataSize && frame >= total) {
+		return 0;
+	}
+
+	if (header.dataSize && total - frame < frames) {
+		frames = total - frame;
+	}
+
+	const size_t bytes = frames * header.blockAlign;
+	size_t bytesRead;
+
+	if (bytesPerSample == 2) {
+		/* 16-bit PCM is already in the right format, so read it straight into the output. */
+		bytesRead = stream.read(out, bytes);
 	} else {
-		logger::error("Unsupported audio format for total seconds calculation.");
-		return 0.0f;
+		/* Convert other sample widths to signed 16-bit, a piece at a time. */
+		uint8_t buffer[WAV_CONVERT_BUFFER];
+		const size_t piece = sizeof(buffer) / header.blockAlign * header.blockAlign;
+		const uint8_t *memory = stream.memory();
+		int16_t *samples = out;
+		bytesRead = 0;
+
+		while (bytesRead < bytes) {
+			// From memory, the rest can be converted in one go.
+			const size_t request = memory || bytes - bytesRead < piece ? bytes - bytesRead : piece;
+			const uint8_t *raw = buffer;
+			size_t count;
+
+			if (memory) {
+				/* Convert straight from memory, rather than copying into the buffer first. */
+				const size_t position = stream.tell();
+				const size_t left = position < stream.size() ? stream.size() - position : 0;
+				count = request < left ? request : left;
+				raw = memory + position;
+				stream.seek(position + count);
+			} else {
+				count = stream.read(buffer, request);
+			}
+			const size_t converted = count / bytesPerSample;
+
+			if (bytesPerSample == 1) {
+				// 8-bit PCM is unsigned.
+				for (size_t i = 0; i < converted; i++) {
+					samples[i] = static_cast<int16_t>((raw[i] - 128) << 8);
+				}
+			} else {
+				// 24-bit PCM, drop the least significant byte.
+				for (size_t i = 0; i < converted; i++) {
+					samples[i] = static_cast<int16_t>(raw[i * 3 + 1] | (raw[i * 3 + 2] << 8));
+				}
+			}
+
+			samples += converted;
+			bytesRead += count;
+			if (count < request) {
+				break;
+			}
+		}
+	}
+
+	// Drop any partial frame so channels stay in step, leaving it to be read again next time.
+	const size_t partial = bytesRead % header.blockAlign;
+	if (partial) {
+		stream.seek(stream.tell() - partial);
 	}
+
+	frames = bytesRead / header.blockAlign;
+	frame += frames;
+	return frames;
 }
 
+bool seekFrame(Source &stream, const header_t &header, unsigned long frame) {
+	/* PCM frames are fixed-size, so this is just an offset into the data chunk. */
+	return stream.seek(header.dataOffset + frame * header.blockAlign);
+}
+
+void encode(uint8_t *out, unsigned long sampleRate, unsigned short channels, unsigned long frames) {
+	const uint32_t blockAlign = channels * sizeof(int16_t);
+	const uint32_t dataSize = frames * blockAlign;
+
+	memcpy(out, "RIFF", 4);
+	put(out + 4, PCM_HEADER_SIZE - 8 + dataSize, 4);
+	memcpy(out + 8, "WAVEfmt ", 8);
+	put(out + 16, 16, 4);
+	put(out + 20, FORMAT_PCM, 2);
+	put(out + 22, channels, 2);
+	put(out + 24, sampleRate, 4);
+	put(out + 28, sampleRate * blockAlign, 4);
+	put(out + 32, blockAlign, 2);
+	put(out + 34, 16, 2);
+	memcpy(out + 36, "data", 4);
+	put(out + 40, dataSize, 4);
+}
+
+} // namespace wav
+
 } // namespace audio
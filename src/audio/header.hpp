@@ -1,7 +1,7 @@
 /// @file header.hpp
 #pragma once
 
-#include "../fs/fileStream.hpp"
+#include "source.hpp"
 #include <vector>
 
 namespace audio {
@@ -12,26 +12,30 @@ namespace audio {
 enum AudioFormat {
 	NO_AUDIO,
 	WAV,
+	MP3,
 	// Add other formats here if needed
 };
 
 namespace wav {
 
+/// The `audioFormat` code for uncompressed PCM data.
+constexpr unsigned short FORMAT_PCM = 0x0001;
+/// The `audioFormat` code for Microsoft ADPCM.
+constexpr unsigned short FORMAT_MS_ADPCM = 0x0002;
+/// The `audioFormat` code for IMA (DVI) ADPCM.
+constexpr unsigned short FORMAT_IMA_ADPCM = 0x0011;
+/// The `audioFormat` code for WAVs that store the real format in an extended `fmt ` chunk.
+constexpr unsigned short FORMAT_EXTENSIBLE = 0xFFFE;
+/// The size of the header written by encode().
+constexpr size_t PCM_HEADER_SIZE = 44;
+
 /**
  * @brief A structure to represent the header of a WAV audio file.
+ * This is filled in by walking the RIFF chunks of the file, so it
+ * contains everything needed to play the file without assuming a fixed header size.
  */
 struct header_t {
-	/// The chunk ID. This should be "RIFF".
-	char chunkID[4];
-	/// The size of the chunk.
-	unsigned long chunkSize;
-	/// The format of the file. This should be "WAVE".
-	char format[4];
-	/// The subchunk ID. This should be "fmt ".
-	char subchunk1ID[4];
-	/// The size of the subchunk. Typically 16 for PCM.
-	unsigned long subchunk1Size;
-	/// The audio format. 1 for PCM.
+	/// The audio format. 1 for PCM, or one of the ADPCM formats. For WAVE_FORMAT_EXTENSIBLE files, this is the sub-format.
 	unsigned short audioFormat;
 	/// The number of channels. 1 for mono, 2 for stereo.
 	unsigned short numChannels;
@@ -39,24 +43,51 @@ struct header_t {
 	unsigned long sampleRate;
 	/// The byte rate. This is sampleRate * numChannels * bitsPerSample/8.
 	unsigned long byteRate;
-	/// The block align.
+	/// The block align. For PCM this is the number of bytes in one frame of all channels,
+	/// for ADPCM it's the number of bytes in one compressed block.
 	unsigned short blockAlign;
 	/// The bits per sample.
 	unsigned short bitsPerSample;
+	/// The offset in bytes of the first sample in the `data` chunk.
+	unsigned long dataOffset;
+	/// The length in bytes of the `data` chunk, or 0 if unknown, in which case the data runs to the end of the file.
+	unsigned long dataSize;
+	/// For ADPCM, the number of frames decoded from each block.
+	unsigned short samplesPerBlock;
+	/// The number of frames from the `fact` chunk, or 0 if there isn't one.
+	unsigned long factFrames;
 };
 
 /**
- * @brief Check if the WAV header is valid.
+ * @brief Check if the WAV data is ADPCM compressed, rather than PCM.
+ * @param header The WAV header.
+ * @return True if the data is IMA or MS ADPCM, false otherwise.
+ */
+bool compressed(const header_t &header);
+
+/**
+ * @brief Check if the WAV header describes audio that can be played.
  * @param header The WAV header to check.
  * @return True if the header is valid, false otherwise.
  */
 bool valid(const header_t &header);
 
+/**
+ * @brief Parse the RIFF chunks of a WAV file, locating the `fmt ` and `data` chunks.
+ * Any other chunks (`LIST`, `fact`, etc.) are skipped.
+ * @param stream The source to parse. This is read from the beginning.
+ * @param header The header to fill in.
+ * @return True if both the `fmt ` and `data` chunks were found, false otherwise.
+ * @note This does not check that the format is supported, use valid() for that.
+ */
+bool parse(Source &stream, header_t &header);
+
 /**
  * @brief Seek to the data section of the WAV file.
- * @param stream The file stream to seek in.
+ * @param stream The source to seek in.
+ * @param header The parsed WAV header.
  */
-void seekData(fs::FileStream &stream);
+void seekData(Source &stream, const header_t &header);
 
 /**
  * @brief Get the sample rate from the WAV header.
@@ -65,55 +96,43 @@ void seekData(fs::FileStream &stream);
  */
 unsigned long sampleRate(const header_t &header);
 
-} // namespace wav
-
 /**
- * @brief A union to represent different audio headers.
- * This allows for reinterpretation of the header based on the audio format.
+ * @brief Get the total number of frames in the WAV file.
+ * @param header The WAV header.
+ * @return The number of frames, where a frame is one sample for every channel, or 0 if the length is unknown.
  */
-union header_t {
-	/// WAV header.
-	wav::header_t wav;
-	// Add other formats here if needed
-
-	/**
-	 * @brief Default constructor for the header_t union.
-	 */
-	header_t();
-};
+unsigned long totalFrames(const header_t &header);
 
 /**
- * @brief Check if the header data belongs to a supported audio format.
- * @param header The audio header to check.
- * @return True if the header is valid, false otherwise.
+ * @brief Read a chunk of PCM data from the WAV file, decoding it into raw signal data.
+ * ADPCM data is decoded a block at a time by AdpcmDecoder instead.
+ * @param stream The source to read from.
+ * @param header The WAV header.
+ * @param frame The frame the stream is currently at. This is advanced by the number of frames read.
+ * @param out The buffer to write signed 16-bit samples to, with channels interleaved.
+ * @param frames The maximum number of frames to read.
+ * @return The number of frames read.
  */
-bool validHeader(const header_t &header);
+size_t getChunk(Source &stream, const header_t &header, unsigned long &frame, int16_t *out, size_t frames);
 
 /**
- * @brief Read a chunk of data from the audio file, decoding it into raw signal data.
- * @param stream The file stream to read from.
- * @param chunkSize The minimum size of the chunk to read.
- * @param format The audio format of the file.
- * @return A vector containing raw signal data.
+ * @brief Seek the stream to a specific frame of PCM audio data.
+ * @param stream The source to seek in.
+ * @param header The WAV header.
+ * @param frame The frame to seek to. A frame is one sample for every channel.
+ * @return True if the seek was successful, false otherwise.
  */
-std::vector<uint16_t> getChunk(fs::FileStream &stream, int chunkSize, AudioFormat format);
+bool seekFrame(Source &stream, const header_t &header, unsigned long frame);
 
 /**
- * @brief Get the current playback time in seconds.
- * @param stream The file stream to read from.
- * @param header The audio file header.
- * @param format The audio format of the file.
- * @return The current playback time in seconds.
+ * @brief Build the header for a 16-bit PCM WAV file.
+ * @param out The buffer to write the header to. This must have room for PCM_HEADER_SIZE bytes.
+ * @param sampleRate The sample rate in Hz.
+ * @param channels The number of channels.
+ * @param frames The number of frames in the file.
  */
-float getCurrentSeconds(const fs::FileStream &stream, const header_t &header, AudioFormat format);
+void encode(uint8_t *out, unsigned long sampleRate, unsigned short channels, unsigned long frames);
 
-/**
- * @brief Get the total duration of the audio file in seconds.
- * @param stream The file stream to read from.
- * @param header The audio file header.
- * @param format The audio format of the file.
- * @return The total duration of the audio file in seconds.
- */
-float getTotalSeconds(const fs::FileStream &stream, const header_t &header, AudioFormat format);
+} // namespace wav
 
 } // namespace audio
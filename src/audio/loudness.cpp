@@ -0,0 +1,149 @@
+#include "loudness.hpp"
+#include "decoder.hpp"
+#include <math.h>
+#include <vector>
+
+/// The number of frames decoded at a time while scanning.
+#define SCAN_BLOCK 1024
+
+namespace audio {
+
+namespace loudness {
+
+/**
+ * @brief A biquad filter, in direct form I.
+ */
+struct Biquad {
+	float b0, b1, b2, a1, a2;
+	float x1, x2, y1, y2;
+
+	float operator()(float x) {
+		const float y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+		x2 = x1;
+		x1 = x;
+		y2 = y1;
+		y1 = y;
+		return y;
+	}
+};
+
+/**
+ * @brief Build the two K-weighting filter stages from BS.1770 for a sample rate.
+ * The standard only gives coefficients at 48kHz, so they are derived from the analog prototypes instead.
+ */
+static void kWeighting(unsigned long sampleRate, Biquad &shelf, Biquad &highPass) {
+	// Stage 1: a high shelf that models the acoustic effect of the head.
+	{
+		const float f0 = 1681.974450955533f;
+		const float G = 3.999843853973347f;
+		const float Q = 0.7071752369554196f;
+		const float K = tanf(static_cast<float>(M_PI) * f0 / sampleRate);
+		const float Vh = powf(10.0f, G / 20.0f);
+		const float Vb = powf(Vh, 0.4996667741545416f);
+		const float a0 = 1.0f + K / Q + K * K;
+
+		shelf = {(Vh + Vb * K / Q + K * K) / a0, 2.0f * (K * K - Vh) / a0, (Vh - Vb * K / Q + K * K) / a0, 2.0f * (K * K - 1.0f) / a0, (1.0f - K / Q + K * K) / a0, 0, 0, 0, 0};
+	}
+
+	// Stage 2: a high pass (the "RLB" curve).
+	{
+		const float f0 = 38.13547087602444f;
+		const float Q = 0.5003270373238773f;
+		const float K = tanf(static_cast<float>(M_PI) * f0 / sampleRate);
+		const float a0 = 1.0f + K / Q + K * K;
+
+		highPass = {1.0f, -2.0f, 1.0f, 2.0f * (K * K - 1.0f) / a0, (1.0f - K / Q + K * K) / a0, 0, 0, 0, 0};
+	}
+}
+
+/// Convert a mean square to loudness in LUFS.
+static float lufs(double meanSquare) {
+	return -0.691f + 10.0f * log10f(static_cast<float>(meanSquare));
+}
+
+bool scan(Source &source, ReplayGain &result) {
+	Decoder *decoder = Decoder::open(source);
+	if (!decoder) {
+		return false;
+	}
+
+	const unsigned long sampleRate = decoder->sampleRate();
+	const unsigned int channels = decoder->channels();
+
+	Biquad shelf[2], highPass[2];
+	for (unsigned int c = 0; c < channels; c++) {
+		kWeighting(sampleRate, shelf[c], highPass[c]);
+	}
+
+	// Gating blocks are 400ms long and overlap by 75%, so sum the energy of 100ms steps then combine every four.
+	const unsigned long stepFrames = sampleRate / 10;
+	std::vector<double> steps;
+	double energy = 0.0;
+	unsigned long stepFill = 0;
+	int peak = 0;
+
+	std::vector<int16_t> buf(SCAN_BLOCK * channels);
+	size_t frames;
+	while ((frames = decoder->read(buf.data(), SCAN_BLOCK)) > 0) {
+		for (size_t i = 0; i < frames; i++) {
+			for (unsigned int c = 0; c < channels; c++) {
+				const int16_t sample = buf[i * channels + c];
+				const int magnitude = sample < 0 ? -sample : sample;
+				if (magnitude > peak) {
+					peak = magnitude;
+				}
+
+				const float y = highPass[c](shelf[c](sample / 32768.0f));
+				energy += y * y;
+			}
+
+			if (++stepFill == stepFrames) {
+				steps.push_back(energy / stepFrames);
+				energy = 0.0;
+				stepFill = 0;
+			}
+		}
+	}
+	delete decoder;
+
+	if (steps.size() < 4) {
+		return false;
+	}
+
+	std::vector<double> blocks(steps.size() - 3);
+	for (size_t i = 0; i < blocks.size(); i++) {
+		blocks[i] = (steps[i] + steps[i + 1] + steps[i + 2] + steps[i + 3]) / 4.0;
+	}
+
+	// Absolute gate: ignore anything below -70 LUFS (silence).
+	double sum = 0.0;
+	size_t count = 0;
+	for (const double block : blocks) {
+		if (block > 0.0 && lufs(block) > -70.0f) {
+			sum += block;
+			count++;
+		}
+	}
+	if (!count) {
+		return false;
+	}
+
+	// Relative gate: ignore blocks more than 10 LU below the average of what's left.
+	const float threshold = lufs(sum / count) - 10.0f;
+	double gated = 0.0;
+	size_t gatedCount = 0;
+	for (const double block : blocks) {
+		if (block > 0.0 && lufs(block) > -70.0f && lufs(block) > threshold) {
+			gated += block;
+			gatedCount++;
+		}
+	}
+
+	result.gain = REFERENCE - lufs(gated / gatedCount);
+	result.peak = peak / 32768.0f;
+	return true;
+}
+
+} // namespace loudness
+
+} // namespace audio
@@ -0,0 +1,31 @@
+/// @file loudness.hpp
+#pragma once
+
+#include "gain.hpp"
+#include "source.hpp"
+
+namespace audio {
+
+namespace loudness {
+
+/// The loudness that ReplayGain 2.0 normalises tracks to, in LUFS.
+constexpr float REFERENCE = -18.0f;
+
+/**
+ * @brief Measure the loudness of a track, for tracks that don't come with ReplayGain metadata.
+ *
+ * Loudness is measured as in ITU-R BS.1770: the audio is K-weighted, then the mean square
+ * is taken over 400ms blocks, ignoring silent blocks and blocks much quieter than the rest of the track.
+ *
+ * @param source The source to read the track from. This is read from the beginning.
+ * @param result Set to the gain that brings the track to REFERENCE, and its peak sample.
+ * @return True if the track was measured, false if it could not be decoded or is silent.
+ *
+ * @warning This decodes the whole track, so it takes a while.
+ * Run it ahead of time (e.g. once a download finishes) rather than when the track starts playing.
+ */
+bool scan(Source &source, ReplayGain &result);
+
+} // namespace loudness
+
+} // namespace audio
@@ -0,0 +1,468 @@
+#include "mp3.hpp"
+#include <libhelix-mp3/mp3dec.h>
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+/// Record the offset of every Nth frame in the seek index.
+#define MP3_INDEX_INTERVAL 8
+
+/// The number of frames to decode and throw away before a seek target, so the bit reservoir is refilled.
+#define MP3_PREROLL_FRAMES 2
+
+/// The delay added by the decoder's filterbank, which encoders don't include in their own delay.
+#define MP3_DECODER_DELAY 529
+
+namespace audio {
+
+namespace mp3 {
+
+static const unsigned short bitratesV1[] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+static const unsigned short bitratesV2[] = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160};
+static const unsigned long sampleRates[] = {44100, 48000, 32000};
+
+/// Read a big-endian 32-bit value from a byte buffer.
+static inline unsigned long be32(const uint8_t *data) {
+	return (static_cast<unsigned long>(data[0]) << 24) | (static_cast<unsigned long>(data[1]) << 16) | (static_cast<unsigned long>(data[2]) << 8) | static_cast<unsigned long>(data[3]);
+}
+
+/// Get the size of the side information that follows the frame header.
+static inline size_t sideInfoSize(const frame_t &frame) {
+	if (frame.version == 1) {
+		return frame.channels == 1 ? 17 : 32;
+	}
+	return frame.channels == 1 ? 9 : 17;
+}
+
+bool parseFrame(const uint8_t *data, frame_t &frame) {
+	if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) {
+		return false; // No frame sync
+	}
+
+	const int versionBits = (data[1] >> 3) & 3;
+	const int layerBits = (data[1] >> 1) & 3;
+	const int bitrateIndex = data[2] >> 4;
+	const int rateIndex = (data[2] >> 2) & 3;
+
+	// Reserved values, free-format bitrates and layers other than III are not supported.
+	if (versionBits == 1 || layerBits != 1 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+		return false;
+	}
+
+	frame.version = versionBits == 3 ? 1 : (versionBits == 2 ? 2 : 3);
+	frame.channels = (data[3] >> 6) == 3 ? 1 : 2;
+	frame.bitrate = (frame.version == 1 ? bitratesV1 : bitratesV2)[bitrateIndex] * 1000UL;
+	frame.sampleRate = sampleRates[rateIndex] >> (frame.version - 1);
+	frame.samples = frame.version == 1 ? 1152 : 576;
+	frame.size = (frame.version == 1 ? 144 : 72) * frame.bitrate / frame.sampleRate + ((data[2] >> 1) & 1);
+
+	return true;
+}
+
+bool parse(Source &stream, header_t &header) {
+	header = {};
+
+	if (!stream.seek(0)) {
+		return false;
+	}
+
+	// Skip over an ID3v2 tag, if there is one.
+	unsigned long offset = 0;
+	uint8_t id3[10];
+	if (stream.read(id3, sizeof(id3)) == sizeof(id3) && memcmp(id3, "ID3", 3) == 0) {
+		offset = 10 + ((id3[6] & 0x7f) << 21 | (id3[7] & 0x7f) << 14 | (id3[8] & 0x7f) << 7 | (id3[9] & 0x7f));
+		if (id3[5] & 0x10) {
+			offset += 10; // Footer
+		}
+	}
+
+	// Look for two consecutive frame headers, so a stray sync word in junk data isn't mistaken for audio.
+	if (!stream.seek(offset)) {
+		return false;
+	}
+	std::vector<uint8_t> data(4096);
+	data.resize(stream.read(data.data(), data.size()));
+
+	// The start of the file may not have been downloaded yet.
+	if (data.size() < 4096 && stream.buffering()) {
+		return false;
+	}
+
+	// Leave off an ID3v1 tag, if there is one. Streams that can't seek back can't check for one.
+	unsigned long end = stream.size();
+	if (end >= 128 && stream.seekable() && stream.seek(end - 128)) {
+		uint8_t tag[3];
+		if (stream.read(tag, sizeof(tag)) == sizeof(tag) && memcmp(tag, "TAG", 3) == 0) {
+			end -= 128;
+		}
+	}
+
+	frame_t frame;
+	size_t start = 0;
+	bool found = false;
+	for (; start + 4 <= data.size(); start++) {
+		if (!parseFrame(data.data() + start, frame)) {
+			continue;
+		}
+
+		const size_t next = start + frame.size;
+		frame_t following;
+		if (next + 4 <= data.size()) {
+			found = parseFrame(data.data() + next, following) && following.sampleRate == frame.sampleRate;
+		} else if (end && offset + next >= end) {
+			// Only a frame that ends exactly at the end of the file goes unconfirmed. One that runs past it is junk.
+			found = offset + next == end;
+		} else {
+			// The following header is past the window, so read it from the stream, carrying on from any part of it in the window.
+			uint8_t more[4];
+			const size_t have = next < data.size() ? data.size() - next : 0;
+			if (have) {
+				memcpy(more, data.data() + next, have);
+			}
+			const bool reached = stream.seek(offset + next + have);
+			const size_t count = reached ? have + stream.read(more + have, sizeof(more) - have) : have;
+
+			if (count == sizeof(more)) {
+				found = parseFrame(more, following) && following.sampleRate == frame.sampleRate;
+			} else if (stream.buffering()) {
+				return false; // The rest of the file hasn't been downloaded yet.
+			} else {
+				found = reached && count == 0; // As above, but for a stream that doesn't know its size.
+			}
+		}
+
+		if (found) {
+			break;
+		}
+	}
+
+	if (!found) {
+		return false;
+	}
+
+	header.sampleRate = frame.sampleRate;
+	header.numChannels = frame.channels;
+	header.samplesPerFrame = frame.samples;
+	header.dataOffset = offset + start;
+
+	// A Xing/Info or VBRI header lives in a frame of silence, in place of the audio data.
+	if (start + frame.size <= data.size()) {
+		const uint8_t *tag = data.data() + start + 4 + sideInfoSize(frame);
+		const uint8_t *frameEnd = data.data() + start + frame.size;
+
+		if (tag + 8 <= frameEnd && (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0)) {
+			const unsigned long flags = be32(tag + 4);
+			const uint8_t *field = tag + 8;
+
+			if (flags & 1) {
+				header.frameCount = be32(field);
+				field += 4;
+			}
+			if (flags & 2) {
+				field += 4; // Byte count
+			}
+			if (flags & 4) {
+				field += 100; // Seek table of contents
+			}
+			if (flags & 8) {
+				field += 4; // Quality
+			}
+
+			// The LAME extension holds the encoder delay and padding, needed for gapless playback.
+			unsigned long encoderDelay = 0;
+			unsigned long padding = 0;
+			if (field + 24 <= frameEnd && (memcmp(field, "LAME", 4) == 0 || memcmp(field, "Lavc", 4) == 0 || memcmp(field, "Lavf", 4) == 0)) {
+				encoderDelay = (field[21] << 4) | (field[22] >> 4);
+				padding = ((field[22] & 0x0f) << 8) | field[23];
+				header.delay = encoderDelay + MP3_DECODER_DELAY;
+			}
+
+			header.dataOffset += frame.size;
+			if (header.frameCount) {
+				const unsigned long samples = header.frameCount * frame.samples;
+				header.totalFrames = samples > encoderDelay + padding ? samples - encoderDelay - padding : 0;
+			}
+		} else {
+			// VBRI always sits 32 bytes after the frame header.
+			const uint8_t *vbri = data.data() + start + 36;
+			if (vbri + 18 <= frameEnd && memcmp(vbri, "VBRI", 4) == 0) {
+				header.frameCount = be32(vbri + 14);
+				header.totalFrames = header.frameCount * frame.samples;
+				header.dataOffset += frame.size;
+			}
+		}
+	}
+
+	header.dataSize = end > header.dataOffset ? end - header.dataOffset : 0;
+
+	// Without a frame count, estimate the length as if the bitrate is constant.
+	if (!header.frameCount) {
+		header.totalFrames = static_cast<unsigned long>(static_cast<uint64_t>(header.dataSize) * 8 * frame.sampleRate / frame.bitrate);
+	}
+
+	return true;
+}
+
+} // namespace mp3
+
+Mp3Decoder::Mp3Decoder(Source &stream, const mp3::header_t &header) : stream(stream), header(header), decoder(nullptr), memory(stream.memory()), input(memory ? 0 : 2 * MAINBUF_SIZE), inputStart(0), inputEnd(0), inputOffset(header.dataOffset), endOfStream(false), pcm(MAX_NCHAN * MAX_NGRAN * MAX_NSAMP), pcmStart(0), pcmEnd(0), frameNumber(0), position(0), discard(header.delay) {
+	decoder = MP3InitDecoder();
+	if (!decoder) {
+		logger::error("Failed to initialize MP3 decoder.");
+		endOfStream = true;
+	}
+
+	index.push_back(header.dataOffset);
+	stream.seek(header.dataOffset);
+}
+
+Mp3Decoder::~Mp3Decoder() {
+	if (decoder) {
+		MP3FreeDecoder(decoder);
+	}
+}
+
+AudioFormat Mp3Decoder::format() const {
+	return MP3;
+}
+
+unsigned long Mp3Decoder::sampleRate() const {
+	return header.sampleRate;
+}
+
+unsigned int Mp3Decoder::channels() const {
+	return header.numChannels;
+}
+
+unsigned long Mp3Decoder::frames() const {
+	return header.totalFrames;
+}
+
+void Mp3Decoder::fill() {
+	// Sources of unknown size are read until they run out.
+	const unsigned long dataEnd = header.dataSize ? header.dataOffset + header.dataSize : ULONG_MAX;
+
+	if (memory) {
+		// The whole file is already in memory, so decode it in place instead of copying it into the input buffer.
+		inputOffset += inputStart;
+		inputStart = 0;
+		const unsigned long end = std::min<unsigned long>(dataEnd, stream.size());
+		inputEnd = end > inputOffset ? end - inputOffset : 0;
+		endOfStream = true;
+		return;
+	}
+
+	// Keep any partial frame, and top the buffer back up behind it.
+	memmove(input.data(), input.data() + inputStart, inputEnd - inputStart);
+	inputOffset += inputStart;
+	inputEnd -= inputStart;
+	inputStart = 0;
+
+	size_t wanted = input.size() - inputEnd;
+	if (inputOffset + inputEnd + wanted > dataEnd) {
+		wanted = dataEnd > inputOffset + inputEnd ? dataEnd - (inputOffset + inputEnd) : 0;
+	}
+
+	const size_t count = stream.read(input.data() + inputEnd, wanted);
+	inputEnd += count;
+
+	// Running out of data that hasn't arrived yet isn't the end.
+	if ((count < wanted && !stream.buffering()) || !wanted) {
+		endOfStream = true;
+	}
+}
+
+const uint8_t *Mp3Decoder::window() const {
+	return memory ? memory + inputOffset : input.data();
+}
+
+bool Mp3Decoder::decodeFrame() {
+	while (true) {
+		if (inputEnd - inputStart < MAINBUF_SIZE && !endOfStream) {
+			fill();
+		}
+
+		if (inputEnd - inputStart < 4) {
+			return false;
+		}
+
+		int sync = MP3FindSyncWord(const_cast<unsigned char *>(window() + inputStart), inputEnd - inputStart);
+		if (sync < 0) {
+			// Keep the last few bytes in case they are the start of a header.
+			inputStart = inputEnd - 3;
+			if (endOfStream || stream.buffering()) {
+				return false;
+			}
+			continue;
+		}
+		inputStart += sync;
+
+		mp3::frame_t frame;
+		if (inputEnd - inputStart < 4 || !mp3::parseFrame(window() + inputStart, frame) || frame.sampleRate != header.sampleRate) {
+			inputStart++; // False sync
+			continue;
+		}
+
+		if (inputEnd - inputStart < frame.size) {
+			if (endOfStream) {
+				return false; // Truncated final frame
+			}
+			if (stream.buffering()) {
+				return false; // The rest of the frame hasn't arrived yet
+			}
+			fill();
+			continue;
+		}
+
+		// Record this frame in the seek index.
+		if (frameNumber % MP3_INDEX_INTERVAL == 0 && frameNumber / MP3_INDEX_INTERVAL == index.size()) {
+			index.push_back(inputOffset + inputStart);
+		}
+
+		// Helix doesn't write to its input, it just isn't declared const.
+		unsigned char *data = const_cast<unsigned char *>(window() + inputStart);
+		int bytesLeft = inputEnd - inputStart;
+		const int error = MP3Decode(decoder, &data, &bytesLeft, pcm.data(), 0);
+
+		inputStart += frame.size;
+		frameNumber++;
+		pcmStart = 0;
+
+		if (error) {
+			// Usually the bit reservoir is not filled yet after a seek.
+			// Output silence so that frame positions stay in step.
+			pcmEnd = frame.samples * header.numChannels;
+			memset(pcm.data(), 0, pcmEnd * sizeof(int16_t));
+			return true;
+		}
+
+		MP3FrameInfo info;
+		MP3GetLastFrameInfo(decoder, &info);
+		pcmEnd = info.outputSamps;
+
+		// The channel count can change mid-stream, but our output can't.
+		if (info.nChans == 2 && header.numChannels == 1) {
+			pcmEnd /= 2;
+			for (size_t i = 0; i < pcmEnd; i++) {
+				pcm[i] = static_cast<int16_t>((pcm[i * 2] + pcm[i * 2 + 1]) / 2);
+			}
+		} else if (info.nChans == 1 && header.numChannels == 2) {
+			for (size_t i = pcmEnd; i-- > 0;) {
+				pcm[i * 2] = pcm[i];
+				pcm[i * 2 + 1] = pcm[i];
+			}
+			pcmEnd *= 2;
+		}
+
+		return true;
+	}
+}
+
+size_t Mp3Decoder::read(int16_t *out, size_t frames) {
+	const unsigned int channels = header.numChannels;
+	size_t count = 0;
+
+	while (count < frames) {
+		// Only trust the length if it came from the file's frame count.
+		if (header.frameCount && position >= header.totalFrames) {
+			break;
+		}
+
+		if (pcmStart >= pcmEnd) {
+			if (!decodeFrame()) {
+				break;
+			}
+			continue;
+		}
+
+		size_t available = (pcmEnd - pcmStart) / channels;
+
+		// Throw away encoder delay and seek pre-roll.
+		if (discard) {
+			const size_t skip = discard < available ? discard : available;
+			pcmStart += skip * channels;
+			discard -= skip;
+			continue;
+		}
+
+		if (available > frames - count) {
+			available = frames - count;
+		}
+		if (header.frameCount && available > header.totalFrames - position) {
+			available = header.totalFrames - position;
+		}
+
+		memcpy(out + count * channels, pcm.data() + pcmStart, available * channels * sizeof(int16_t));
+		pcmStart += available * channels;
+		count += available;
+		position += available;
+	}
+
+	return count;
+}
+
+bool Mp3Decoder::locate(unsigned long frame) {
+	// Jump to the closest indexed frame before the target.
+	unsigned long slot = frame / MP3_INDEX_INTERVAL;
+	if (slot >= index.size()) {
+		slot = index.size() - 1;
+	}
+
+	unsigned long current = slot * MP3_INDEX_INTERVAL;
+	unsigned long offset = index[slot];
+
+	// Walk frame headers the rest of the way, extending the index as we go.
+	while (current < frame) {
+		if (!stream.seek(offset)) {
+			return false;
+		}
+
+		uint8_t data[4];
+		mp3::frame_t info;
+		if (stream.read(data, sizeof(data)) < sizeof(data) || !mp3::parseFrame(data, info)) {
+			return false;
+		}
+
+		offset += info.size;
+		current++;
+
+		if (current % MP3_INDEX_INTERVAL == 0 && current / MP3_INDEX_INTERVAL == index.size()) {
+			index.push_back(offset);
+		}
+	}
+
+	if (!stream.seek(offset)) {
+		return false;
+	}
+
+	inputStart = 0;
+	inputEnd = 0;
+	inputOffset = offset;
+	endOfStream = false;
+	frameNumber = frame;
+	return true;
+}
+
+bool Mp3Decoder::seek(unsigned long frame) {
+	if (header.frameCount && frame > header.totalFrames) {
+		frame = header.totalFrames;
+	}
+
+	// Start a couple of frames early, since a frame's data can begin in the frames before it.
+	const unsigned long sample = frame + header.delay;
+	const unsigned long target = sample / header.samplesPerFrame;
+	const unsigned long start = target > MP3_PREROLL_FRAMES ? target - MP3_PREROLL_FRAMES : 0;
+
+	if (!locate(start)) {
+		logger::error("Failed to locate MP3 frame.");
+		return false;
+	}
+
+	pcmStart = 0;
+	pcmEnd = 0;
+	discard = sample - start * header.samplesPerFrame;
+	position = frame;
+	return true;
+}
+
+} // namespace audio
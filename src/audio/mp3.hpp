@@ -0,0 +1,121 @@
+/// @file mp3.hpp
+#pragma once
+
+#include "decoder.hpp"
+
+namespace audio {
+
+namespace mp3 {
+
+/**
+ * @brief A structure to represent the header of a single MPEG Layer III frame.
+ */
+struct frame_t {
+	/// The MPEG version. 1 for MPEG-1, 2 for MPEG-2, 3 for MPEG-2.5.
+	unsigned short version;
+	/// The number of channels. 1 for mono, 2 for stereo.
+	unsigned short channels;
+	/// The bitrate in bits per second.
+	unsigned long bitrate;
+	/// The sample rate in Hz.
+	unsigned long sampleRate;
+	/// The number of samples (per channel) that the frame decodes to.
+	unsigned short samples;
+	/// The total size of the frame in bytes, including this header.
+	unsigned short size;
+};
+
+/**
+ * @brief A structure to represent the overall properties of an MP3 file.
+ */
+struct header_t {
+	/// The sample rate in Hz.
+	unsigned long sampleRate;
+	/// The number of channels. 1 for mono, 2 for stereo.
+	unsigned short numChannels;
+	/// The number of samples (per channel) in each frame.
+	unsigned short samplesPerFrame;
+	/// The offset in bytes of the first frame of audio, after any ID3 tag or Xing/Info frame.
+	unsigned long dataOffset;
+	/// The length in bytes of the audio frames, excluding any trailing ID3v1 tag.
+	unsigned long dataSize;
+	/// The number of MPEG frames, from the Xing/Info or VBRI header. 0 if unknown.
+	unsigned long frameCount;
+	/// The number of decoded frames to skip at the start (encoder and decoder delay).
+	unsigned short delay;
+	/// The number of frames of audio. This is only an estimate if frameCount is 0.
+	unsigned long totalFrames;
+};
+
+/**
+ * @brief Parse the 4-byte header of an MPEG audio frame.
+ * @param data At least 4 bytes of data, starting at the frame sync.
+ * @param frame The frame header to fill in.
+ * @return True if this is a valid MPEG Layer III frame header, false otherwise.
+ */
+bool parseFrame(const uint8_t *data, frame_t &frame);
+
+/**
+ * @brief Find the first audio frame of an MP3 file, and read its length from the Xing/Info or VBRI header if it has one.
+ * @param stream The source to parse. This is read from the beginning.
+ * @param header The header to fill in.
+ * @return True if the file contains MPEG Layer III audio, false otherwise.
+ */
+bool parse(Source &stream, header_t &header);
+
+} // namespace mp3
+
+/**
+ * @brief A decoder for MP3 files.
+ *
+ * Frames are read into a bounded input buffer and decoded one at a time by the Helix fixed-point decoder.
+ * As frames are decoded, the offset of every few frames is recorded in a seek index.
+ * Seeking within the indexed part of the file is a direct lookup plus a few frame headers,
+ * and seeking past it extends the index by walking frame headers (without decoding) up to the target.
+ */
+class Mp3Decoder : public Decoder {
+	Source &stream;
+	mp3::header_t header;
+	void *decoder;
+	const uint8_t *memory;
+
+	std::vector<uint8_t> input;
+	size_t inputStart;
+	size_t inputEnd;
+	unsigned long inputOffset;
+	bool endOfStream;
+
+	std::vector<int16_t> pcm;
+	size_t pcmStart;
+	size_t pcmEnd;
+
+	unsigned long frameNumber;
+	unsigned long position;
+	unsigned long discard;
+	std::vector<uint32_t> index;
+
+	void fill();
+	const uint8_t *window() const;
+	bool decodeFrame();
+	bool locate(unsigned long frame);
+
+public:
+	/**
+	 * @brief Constructor for the Mp3Decoder class.
+	 * @param stream The source to decode.
+	 * @param header The parsed MP3 header.
+	 */
+	Mp3Decoder(Source &stream, const mp3::header_t &header);
+
+	/// Destructor.
+	~Mp3Decoder();
+
+	AudioFormat format() const override;
+	unsigned long sampleRate() const override;
+	unsigned int channels() const override;
+	unsigned long frames() const override;
+	size_t read(int16_t *out, size_t frames) override;
+	bool seek(unsigned long frame) override;
+};
+
+} // namespace audio
@@ -1,103 +1,171 @@
 #include "player.hpp"
+#include "dac.hpp"
+#include "telemetry.hpp"
 #include <Arduino.h>
-
-#ifndef EMULATE
-#include <Arduino_AdvancedAnalog.h>
-#else
-#warning "Audio playback not supported when emulating. No sound will be produced!"
+#include <limits.h>
 #include <string.h>
-#endif
 
 namespace audio {
 
-#ifndef EMULATE
-static AdvancedDAC dac0(A12);
-#endif
+Player::Player(const fs::Path &file) : Player(openFile(file)) {}
 
-Player::Player(const fs::Path &file) : initialized(false), playing(false), format(NO_AUDIO), stream(file.stream()), currentSeconds(0.0f) {
-	if (!stream) {
-		logger::error("Failed to open audio file stream.");
+Player::Player(Source *source) : initialized(false), playing(false), finishing(false), waiting(false), stalled(false), source(source), decoder(nullptr), sampleRate(0), channels(0), seekPosition(0), totalFrames(0), replayGain{0.0f, 0.0f}, chunkSize(0), chunkOffset(0) {
+	if (!source || !*source) {
+		logger::error("Failed to open audio source.");
 		return;
 	}
 
-	stream.seek(0);
-
-	// Read file header to determine type
-	auto headerData = stream.read<uint8_t>(sizeof(header));
-	memcpy(&header, headerData.data(), headerData.size());
+	load();
+}
 
-	if (!validHeader(header)) {
-		logger::error("Invalid audio file header, cannot play.");
+void Player::load() {
+	// Look at the file contents to determine type
+	decoder = Decoder::open(*source);
+	if (!decoder) {
+		// The header may just not have been downloaded yet, so try again later.
+		waiting = source->buffering();
+		if (!waiting) {
+			logger::error("Unsupported audio format.");
+		}
 		return;
 	}
+	waiting = false;
 
-	unsigned long sampleRate = -1;
+	sampleRate = decoder->sampleRate();
+	channels = decoder->channels();
+	totalFrames = decoder->frames();
+	resampler = Resampler(sampleRate, channels);
+	chunk.resize(Resampler::BLOCK * channels);
 
-	if (wav::valid(header.wav)) {
-		format = WAV;
-		wav::seekData(stream);
-		sampleRate = wav::sampleRate(header.wav);
-	} else {
-		logger::error("Unsupported audio format.");
+	/* The DAC runs at a fixed rate, so it only needs to be started once. */
+	if (!dac::begin()) {
 		return;
 	}
 
-#ifndef EMULATE
-	/* Configure the advanced DAC. */
-	if (!dac0.begin(AN_RESOLUTION_12, sampleRate * 2, 256, 16)) {
-		logger::error("Failed to start DAC0!");
-		return;
+	logger::info("Player initialized for file.");
+
+	initialized = true;
+}
+
+Player::~Player() {
+	delete decoder;
+	delete source;
+}
+
+bool Player::decode() {
+	const unsigned long start = micros();
+	chunkSize = decoder->read(chunk.data(), Resampler::BLOCK) * channels;
+	telemetry::decoded(micros() - start);
+	chunkOffset = 0;
+	return chunkSize > 0;
+}
+
+size_t Player::read(int16_t *out, size_t count) {
+	stalled = false;
+
+	if (waiting) {
+		load();
+		if (waiting) {
+			stalled = true;
+			return 0;
+		}
 	}
-#endif
 
-	totalSeconds = getTotalSeconds(stream, header, format);
+	if (!initialized) {
+		return 0;
+	}
 
-	logger::info("Player initialized for file.");
+	size_t produced = 0;
+
+	while (produced < count) {
+		produced += resampler.read(out + produced, count - produced);
+		if (produced >= count) {
+			break;
+		}
+
+		// The resampler needs more input.
+		if (chunkOffset >= chunkSize) {
+			if (finishing) {
+				break; // Nothing left to decode.
+			}
+
+			if (!decode()) {
+				// Out of data for now, but not finished. Don't flush the resampler, the audio carries on later.
+				if (source->buffering()) {
+					stalled = true;
+					break;
+				}
+
+				resampler.flush();
+				finishing = true;
+				continue;
+			}
+		}
+
+		chunkOffset += resampler.write(chunk.data() + chunkOffset, (chunkSize - chunkOffset) / channels) * channels;
+	}
 
-	initialized = true;
+	return produced;
 }
 
-bool Player::output() {
-	if (!playing) {
-		return false;
+void Player::prime() {
+	if (waiting) {
+		load();
 	}
 
-#ifndef EMULATE
-	if (!initialized || !dac0.available()) {
-		return false;
+	if (!initialized || finishing || chunkOffset < chunkSize) {
+		return;
 	}
 
-	if (!format) {
-		return false;
+	if (decode()) {
+		chunkOffset = resampler.write(chunk.data(), chunkSize / channels) * channels;
 	}
+}
 
-	SampleBuffer buf = dac0.dequeue();
+void Player::prefetch() {
+	if (source) {
+		source->prefetch();
+	}
+}
 
-	// Get the next chunk of audio data if the current chunk is empty or too small.
-	if (chunk.size() < buf.size()) {
-		auto ch = getChunk(stream, buf.size(), format);
-		chunk.insert(chunk.end(), ch.begin(), ch.end());
+bool Player::output() {
+	if (!playing) {
+		return false;
 	}
 
-	if (chunk.size() < buf.size()) {
-		initialized = false; // Reset if no data is available
+	if (!(initialized || waiting) || !dac::available()) {
 		return false;
 	}
 
-	// Write raw signal data to buffer.
-	for (size_t i = 0; i < buf.size(); i++) {
-		// Scale down to 12 bit.
-		uint16_t const dac_val = ((static_cast<unsigned int>(chunk[i]) + 32768) >> 4) & 0x0fff;
-		buf[i] = dac_val;
+	const unsigned long start = micros();
+	int16_t buf[dac::BUFFER_SIZE];
+	size_t count = read(buf, dac::BUFFER_SIZE);
+
+	if (count < dac::BUFFER_SIZE) {
+		// While buffering, keep the DAC fed with silence until more data arrives.
+		if (stalled) {
+			telemetry::stall();
+		} else {
+			// The end of the audio, not an underrun.
+			initialized = false; // Reset if no data is available
+			if (!count) {
+				dac::idle();
+				return false;
+			}
+		}
+
+		// Pad out the last buffer with silence.
+		memset(buf + count, 0, (dac::BUFFER_SIZE - count) * sizeof(int16_t));
 	}
-	// Remove the processed data from the chunk.
-	chunk.erase(chunk.begin(), chunk.begin() + buf.size());
 
 	// Write the buffer to DAC.
-	dac0.write(buf);
-#endif
+	dac::gain().setReplayGain(replayGain);
+	dac::write(buf);
+	telemetry::refilled(micros() - start);
 
-	currentSeconds = getCurrentSeconds(stream, header, format);
+	if (!initialized) {
+		dac::idle();
+	}
 
 	return true;
 }
@@ -108,10 +176,15 @@ void Player::play() {
 
 void Player::pause() {
 	playing = false;
+	dac::idle();
 }
 
 bool Player::finished() const {
-	return !initialized;
+	return !initialized && !waiting;
+}
+
+bool Player::buffering() const {
+	return stalled;
 }
 
 void Player::seek(float seconds) {
@@ -120,7 +193,30 @@ void Player::seek(float seconds) {
 		return;
 	}
 
-	// TODO: Implement seeking functionality
+	unsigned long frame = seconds > 0.0f ? static_cast<unsigned long>(seconds * sampleRate) : 0;
+	if (totalFrames && frame > totalFrames) {
+		frame = totalFrames;
+	}
+
+	if (!decoder->seek(frame)) {
+		logger::error("Failed to seek audio stream.");
+		return;
+	}
+
+	// Anything already decoded is from the old position.
+	chunkSize = 0;
+	chunkOffset = 0;
+	resampler.reset();
+	finishing = false;
+	seekPosition = frame;
+}
+
+void Player::setReplayGain(const ReplayGain &replayGain) {
+	this->replayGain = replayGain;
+}
+
+const ReplayGain &Player::getReplayGain() const {
+	return replayGain;
 }
 
 float Player::progress() {
@@ -129,7 +225,7 @@ float Player::progress() {
 		return 0.0f;
 	}
 
-	return (currentSeconds / totalSeconds) * 100.0f;
+	return totalFrames ? (static_cast<float>(position()) / totalFrames) * 100.0f : 0.0f;
 }
 
 float Player::seconds() {
@@ -138,7 +234,7 @@ float Player::seconds() {
 		return 0.0f;
 	}
 
-	return currentSeconds;
+	return static_cast<float>(position()) / sampleRate;
 }
 
 float Player::duration() {
@@ -147,11 +243,26 @@ float Player::duration() {
 		return 0.0f;
 	}
 
-	return totalSeconds;
+	return static_cast<float>(totalFrames) / sampleRate;
+}
+
+unsigned long Player::remaining() const {
+	if (!sampleRate) {
+		return 0;
+	}
+	if (!totalFrames) {
+		return ULONG_MAX; // The length is unknown, so the end could be anywhere.
+	}
+	return static_cast<uint64_t>(totalFrames - position()) * AUDIO_OUTPUT_RATE / sampleRate;
 }
 
 bool Player::good() const {
-	return initialized;
+	return initialized || waiting;
+}
+
+unsigned long Player::position() const {
+	unsigned long frame = seekPosition + resampler.position();
+	return !totalFrames || frame < totalFrames ? frame : totalFrames;
 }
 
 } // namespace audio
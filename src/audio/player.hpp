@@ -1,35 +1,69 @@
 /// @file player.hpp
 #pragma once
 
-#include "../fs/fileStream.hpp"
 #include "../fs/path.hpp"
 #include "../logger.hpp"
-#include "header.hpp"
+#include "decoder.hpp"
+#include "gain.hpp"
+#include "resampler.hpp"
+#include "source.hpp"
 #include <vector>
 
 namespace audio {
 
 /**
- * @brief A class to stream audio from a file.
+ * @brief A class to stream audio from a file, or any other Source.
  * This class abstracts away the exact handling of each audio format
  * and provides a unified interface for playback.
+ * Audio is resampled to AUDIO_OUTPUT_RATE, so the DAC is never reconfigured between tracks.
  *
  * @note Currently supported formats are:
- * - WAV
+ * - WAV (8, 16 or 24-bit PCM or 4-bit IMA/Microsoft ADPCM, mono or stereo)
+ * - MP3 (MPEG-1, 2 and 2.5 Layer III)
  *
- * @todo Implement support for other audio formats (e.g., MP3, AAC).
+ * @todo Implement support for other audio formats (e.g., AAC).
  */
 class Player {
 	bool initialized;
 	bool playing;
-	AudioFormat format;
-	fs::FileStream stream;
+	bool finishing;
+	/// Whether the start of the audio is still being downloaded, so the format isn't known yet.
+	bool waiting;
+	/// Whether the last read came up short because the source is buffering.
+	bool stalled;
+	Source *source;
+	Decoder *decoder;
+
+	unsigned long sampleRate;
+	unsigned int channels;
+	/// The frame that playback was last started or seeked from.
+	unsigned long seekPosition;
+	unsigned long totalFrames;
+
+	ReplayGain replayGain;
+
+	std::vector<int16_t> chunk;
+	size_t chunkSize;
+	size_t chunkOffset;
+	Resampler resampler;
 
-	float currentSeconds;
-	float totalSeconds;
+	/**
+	 * @brief Detect the format of the source and set up decoding.
+	 * If the source is still buffering the start of the audio, this is retried on later reads.
+	 */
+	void load();
 
-	header_t header;
-	std::vector<uint16_t> chunk;
+	/**
+	 * @brief Decode the next chunk of audio into the chunk buffer.
+	 * @return True if any audio was decoded, false at the end of the audio.
+	 */
+	bool decode();
+
+	/**
+	 * @brief Get the source frame currently being output.
+	 * @return The frame index.
+	 */
+	unsigned long position() const;
 
 public:
 	/**
@@ -38,6 +72,41 @@ public:
 	 */
 	Player(const fs::Path &file);
 
+	/**
+	 * @brief Constructor for the Player class.
+	 * @param source The source to read audio from. The player takes ownership of it.
+	 */
+	Player(Source *source);
+
+	/// Destructor.
+	~Player();
+
+	Player(const Player &) = delete;
+	Player &operator=(const Player &) = delete;
+
+	/**
+	 * @brief Decode and resample audio into a buffer.
+	 * This is how the audio data is pulled when something other than the player
+	 * is feeding the audio device, e.g. an Engine splicing tracks together.
+	 * @param out The buffer to write mono samples at AUDIO_OUTPUT_RATE to.
+	 * @param count The number of samples to write.
+	 * @return The number of samples written. This is only less than `count` at the end of the audio,
+	 * or if the source is buffering (see buffering()).
+	 */
+	size_t read(int16_t *out, size_t count);
+
+	/**
+	 * @brief Decode the first block of audio ahead of time,
+	 * so that playback can start without waiting on the file.
+	 */
+	void prime();
+
+	/**
+	 * @brief Read upcoming data from the source ahead of time, if it supports it.
+	 * @note This should be called regularly from the main loop, outside the time-critical output().
+	 */
+	void prefetch();
+
 	/**
 	 * @brief Output the audio data to the audio device.
 	 * @return True if the output was successful, false otherwise (invalid audio or playback is finished).
@@ -60,13 +129,33 @@ public:
 	 */
 	bool finished() const;
 
+	/**
+	 * @brief Check if playback has caught up with a source that is still arriving, e.g. a download in progress.
+	 * While buffering, output() plays silence and reads come up short without blocking,
+	 * then playback carries on from the same place once more data is available.
+	 * @return True if the last read ran out of data before the end of the audio, false otherwise.
+	 */
+	bool buffering() const;
+
 	/**
 	 * @brief Seek to a specific time in the audio file.
 	 * @param seconds The time in seconds to seek to.
-	 * @todo Implement this!!
+	 * This is clamped to the length of the audio.
 	 */
 	void seek(float seconds);
 
+	/**
+	 * @brief Set the ReplayGain to apply while this track is playing.
+	 * @param replayGain The ReplayGain of the track, e.g. from Subsonic metadata or loudness::scan().
+	 */
+	void setReplayGain(const ReplayGain &replayGain);
+
+	/**
+	 * @brief Get the ReplayGain applied while this track is playing.
+	 * @return The ReplayGain of the track. The gain is 0 dB if none was set.
+	 */
+	const ReplayGain &getReplayGain() const;
+
 	/**
 	 * @brief Get the current playback progress as a percentage.
 	 * @return The current playback progress as a percentage (0.0 to 100.0).
@@ -85,6 +174,12 @@ public:
 	 */
 	float duration();
 
+	/**
+	 * @brief Get the amount of audio left to play.
+	 * @return The number of samples at AUDIO_OUTPUT_RATE until the end of the audio, or ULONG_MAX if its length is unknown.
+	 */
+	unsigned long remaining() const;
+
 	/**
 	 * @brief Check if the audio player is in a good state.
 	 * @return True if the audio player is good, false otherwise.
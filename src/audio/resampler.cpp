@@ -0,0 +1,239 @@
+#include "resampler.hpp"
+#include <string.h>
+
+namespace audio {
+
+constexpr size_t Resampler::TAPS;
+constexpr unsigned int Resampler::PHASE_BITS;
+constexpr size_t Resampler::PHASES;
+constexpr size_t Resampler::BLOCK;
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+
+/// A compile-time sine, since std::sin is not constexpr.
+constexpr double sine(double x) {
+	while (x > PI) {
+		x -= 2 * PI;
+	}
+	while (x < -PI) {
+		x += 2 * PI;
+	}
+
+	double term = x;
+	double sum = x;
+	for (int i = 1; i < 12; i++) {
+		term *= -x * x / ((2 * i) * (2 * i + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double cosine(double x) {
+	return sine(x + PI / 2);
+}
+
+/**
+ * A table of windowed-sinc filter coefficients in Q15.
+ * There is one extra phase at the end so the last phase can be interpolated towards the next sample.
+ * @tparam Cutoff The cutoff frequency, in thousandths of the source sample rate.
+ */
+template <int Cutoff>
+struct FilterTable {
+	int16_t taps[Resampler::PHASES + 1][Resampler::TAPS];
+
+	constexpr FilterTable() : taps() {
+		const double fc = Cutoff / 1000.0;
+		const double half = Resampler::TAPS / 2;
+
+		for (size_t p = 0; p <= Resampler::PHASES; p++) {
+			double h[Resampler::TAPS] = {};
+			double sum = 0;
+
+			for (size_t k = 0; k < Resampler::TAPS; k++) {
+				// Distance from the output sample to this input sample.
+				const double d = static_cast<double>(k) - (half - 1) - static_cast<double>(p) / Resampler::PHASES;
+				if (d <= -half || d >= half) {
+					continue;
+				}
+
+				const double x = 2 * PI * fc * d;
+				const double sinc = (d == 0) ? 2 * fc : sine(x) / (PI * d);
+				const double blackman = 0.42 + 0.5 * cosine(PI * d / half) + 0.08 * cosine(2 * PI * d / half);
+				h[k] = sinc * blackman;
+				sum += h[k];
+			}
+
+			// Normalize each phase to unity gain so there is no ripple at DC.
+			for (size_t k = 0; k < Resampler::TAPS; k++) {
+				const double v = h[k] / sum * 32768;
+				taps[p][k] = static_cast<int16_t>(v >= 0 ? v + 0.5 : v - 0.5);
+			}
+		}
+	}
+};
+
+static constexpr FilterTable<450> filter450{};
+static constexpr FilterTable<400> filter400{};
+static constexpr FilterTable<300> filter300{};
+static constexpr FilterTable<200> filter200{};
+static constexpr FilterTable<100> filter100{};
+
+/// The available filters, from highest to lowest cutoff.
+static const struct {
+	int cutoff;
+	const int16_t (*taps)[Resampler::TAPS];
+} filters[] = {
+	{450, filter450.taps},
+	{400, filter400.taps},
+	{300, filter300.taps},
+	{200, filter200.taps},
+	{100, filter100.taps},
+};
+
+} // namespace
+
+Resampler::Resampler(unsigned long inputRate, unsigned int channels) : table(nullptr), channels(channels ? channels : 1) {
+	if (!inputRate) {
+		inputRate = AUDIO_OUTPUT_RATE;
+	}
+
+	step = (static_cast<uint64_t>(inputRate) << 32) / AUDIO_OUTPUT_RATE;
+
+	if (inputRate != AUDIO_OUTPUT_RATE) {
+		// Keep the cutoff below the Nyquist frequency of whichever rate is lower.
+		const unsigned long lowest = inputRate < AUDIO_OUTPUT_RATE ? inputRate : AUDIO_OUTPUT_RATE;
+		const int target = static_cast<int>(450 * static_cast<uint64_t>(lowest) / inputRate);
+
+		table = filters[sizeof(filters) / sizeof(filters[0]) - 1].taps;
+		for (const auto &filter : filters) {
+			if (filter.cutoff <= target) {
+				table = filter.taps;
+				break;
+			}
+		}
+	}
+
+	reset();
+}
+
+void Resampler::reset() {
+	pos = 0;
+	consumed = 0;
+
+	// Pre-fill with silence so the first output is centered on the first input sample.
+	fill = passthrough() ? 0 : TAPS / 2 - 1;
+	memset(window, 0, sizeof(window));
+}
+
+void Resampler::append(const int16_t *samples, size_t frames) {
+	int16_t *dest = window + fill;
+
+	if (!samples) {
+		memset(dest, 0, frames * sizeof(int16_t));
+	} else if (channels == 1) {
+		memcpy(dest, samples, frames * sizeof(int16_t));
+	} else {
+		for (size_t i = 0; i < frames; i++) {
+			int32_t sum = 0;
+			for (unsigned int c = 0; c < channels; c++) {
+				sum += samples[i * channels + c];
+			}
+			dest[i] = static_cast<int16_t>(sum / static_cast<int32_t>(channels));
+		}
+	}
+
+	fill += frames;
+}
+
+size_t Resampler::write(const int16_t *samples, size_t frames) {
+	const size_t space = TAPS + BLOCK - fill;
+	if (frames > space) {
+		frames = space;
+	}
+
+	append(samples, frames);
+	return frames;
+}
+
+void Resampler::flush() {
+	if (passthrough()) {
+		return;
+	}
+
+	size_t frames = TAPS / 2;
+	if (frames > TAPS + BLOCK - fill) {
+		frames = TAPS + BLOCK - fill;
+	}
+	append(nullptr, frames);
+}
+
+size_t Resampler::read(int16_t *out, size_t count) {
+	size_t n = 0;
+
+	if (passthrough()) {
+		while (n < count && (pos >> 32) < fill) {
+			out[n++] = window[pos >> 32];
+			pos += step;
+		}
+	} else {
+		while (n < count) {
+			const size_t index = pos >> 32;
+			if (index + TAPS > fill) {
+				break;
+			}
+
+			const uint32_t frac = static_cast<uint32_t>(pos);
+			const int16_t *x = window + index;
+			const int16_t *h0 = table[frac >> (32 - PHASE_BITS)];
+			const int16_t *h1 = h0 + TAPS;
+
+			int32_t a = 0;
+			int32_t b = 0;
+			for (size_t k = 0; k < TAPS; k++) {
+				a += x[k] * h0[k];
+				b += x[k] * h1[k];
+			}
+
+			// Interpolate between the two nearest phases.
+			const int32_t weight = (frac >> (32 - PHASE_BITS - 15)) & 0x7fff;
+			int32_t y = a + static_cast<int32_t>((static_cast<int64_t>(b - a) * weight) >> 15);
+			y >>= 15;
+
+			if (y > 32767) {
+				y = 32767;
+			} else if (y < -32768) {
+				y = -32768;
+			}
+
+			out[n++] = static_cast<int16_t>(y);
+			pos += step;
+		}
+	}
+
+	// Drop input that no future output will need.
+	size_t drop = pos >> 32;
+	if (drop > fill) {
+		drop = fill;
+	}
+
+	if (drop) {
+		memmove(window, window + drop, (fill - drop) * sizeof(int16_t));
+		fill -= drop;
+		pos -= static_cast<uint64_t>(drop) << 32;
+		consumed += drop;
+	}
+
+	return n;
+}
+
+unsigned long Resampler::position() const {
+	return consumed + (pos >> 32);
+}
+
+bool Resampler::passthrough() const {
+	return table == nullptr;
+}
+
+} // namespace audio
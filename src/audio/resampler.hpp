@@ -0,0 +1,92 @@
+/// @file resampler.hpp
+#pragma once
+
+#include "dac.hpp"
+
+namespace audio {
+
+/**
+ * @brief A fixed-point polyphase sample-rate converter.
+ *
+ * Audio is written in at its source rate and read out as mono at AUDIO_OUTPUT_RATE,
+ * so the DAC never has to be reconfigured between tracks. Stereo input is mixed down to mono,
+ * since the audio jack is driven from a single DAC channel.
+ *
+ * The filter is a windowed sinc with TAPS taps, split into PHASES phases.
+ * Outputs that land between two phases are linearly interpolated between them.
+ * The coefficient tables are generated at compile time, one per cutoff frequency,
+ * and the table is chosen based on the conversion ratio so that downsampling does not alias.
+ *
+ * When the source rate already matches the output rate, samples are passed through unfiltered.
+ */
+class Resampler {
+public:
+	/// The number of filter taps per phase.
+	static constexpr size_t TAPS = 16;
+	/// The number of bits used to select a filter phase.
+	static constexpr unsigned int PHASE_BITS = 6;
+	/// The number of filter phases per input sample.
+	static constexpr size_t PHASES = 1 << PHASE_BITS;
+	/// The maximum number of input frames buffered at once.
+	static constexpr size_t BLOCK = 512;
+
+private:
+	const int16_t (*table)[TAPS];
+	uint64_t step;
+	uint64_t pos;
+	unsigned long consumed;
+	unsigned int channels;
+	size_t fill;
+	int16_t window[TAPS + BLOCK];
+
+	void append(const int16_t *samples, size_t frames);
+
+public:
+	/**
+	 * @brief Constructor for the Resampler class.
+	 * @param inputRate The sample rate of the audio being written.
+	 * @param channels The number of interleaved channels in the audio being written.
+	 */
+	Resampler(unsigned long inputRate = AUDIO_OUTPUT_RATE, unsigned int channels = 1);
+
+	/**
+	 * @brief Discard all buffered audio, e.g. after seeking.
+	 */
+	void reset();
+
+	/**
+	 * @brief Write source audio into the resampler.
+	 * @param samples The interleaved samples to write.
+	 * @param frames The number of frames available in `samples`.
+	 * @return The number of frames that were accepted. Any remaining frames should be written after calling read().
+	 */
+	size_t write(const int16_t *samples, size_t frames);
+
+	/**
+	 * @brief Mark the end of the source audio.
+	 * This pushes silence through the filter so that the last few samples can be read out.
+	 */
+	void flush();
+
+	/**
+	 * @brief Read resampled audio out of the resampler.
+	 * @param out The buffer to write mono samples to.
+	 * @param count The maximum number of samples to read.
+	 * @return The number of samples read. If less than `count`, more audio must be written first.
+	 */
+	size_t read(int16_t *out, size_t count);
+
+	/**
+	 * @brief Get the source frame that the next output sample will be taken from.
+	 * @return The number of source frames consumed since the last reset.
+	 */
+	unsigned long position() const;
+
+	/**
+	 * @brief Check if samples are passed through without filtering.
+	 * @return True if the source rate matches the output rate, false otherwise.
+	 */
+	bool passthrough() const;
+};
+
+} // namespace audio
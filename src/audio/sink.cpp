@@ -0,0 +1,159 @@
+#include "sink.hpp"
+#include "header.hpp"
+#include "../logger.hpp"
+#include <Arduino.h>
+#include <string.h>
+
+#ifndef EMULATE
+#include <Arduino_AdvancedAnalog.h>
+#endif
+
+namespace audio {
+
+#ifndef EMULATE
+static AdvancedDAC dac0(A12);
+static DMABuffer<Sample> *pendingBuffer = nullptr;
+
+bool DacSink::begin() {
+	/* Configure the advanced DAC. */
+	if (!dac0.begin(AN_RESOLUTION_12, AUDIO_OUTPUT_RATE, dac::BUFFER_SIZE, dac::QUEUE_DEPTH)) {
+		logger::error("Failed to start DAC0!");
+		return false;
+	}
+	return true;
+}
+
+bool DacSink::available() {
+	return dac0.available();
+}
+
+uint16_t *DacSink::acquire() {
+	pendingBuffer = &dac0.dequeue();
+	return pendingBuffer->data();
+}
+
+void DacSink::commit() {
+	dac0.write(*pendingBuffer);
+	pendingBuffer = nullptr;
+}
+#endif
+
+NullSink::NullSink(size_t depth, bool realTime) : depth(depth ? depth : 1), realTime(realTime), queued(0), lastMicros(0), elapsed(0) {}
+
+void NullSink::drain() {
+	if (!realTime) {
+		queued = 0;
+		return;
+	}
+
+	const unsigned long now = micros();
+	if (!queued) {
+		// Nothing is playing, so there's no time to catch up on.
+		lastMicros = now;
+		elapsed = 0;
+		return;
+	}
+
+	// Count time in units of samples * microseconds, so that no rounding error builds up.
+	elapsed += static_cast<uint64_t>(now - lastMicros) * AUDIO_OUTPUT_RATE;
+	lastMicros = now;
+
+	const uint64_t bufferTime = static_cast<uint64_t>(dac::BUFFER_SIZE) * 1000000;
+	while (queued && elapsed >= bufferTime) {
+		elapsed -= bufferTime;
+		queued--;
+	}
+}
+
+size_t NullSink::pending() {
+	drain();
+	return queued;
+}
+
+bool NullSink::begin() {
+	queued = 0;
+	elapsed = 0;
+	lastMicros = micros();
+	return true;
+}
+
+bool NullSink::available() {
+	drain();
+	return queued < depth;
+}
+
+uint16_t *NullSink::acquire() {
+	return buffer;
+}
+
+void NullSink::commit() {
+	drain();
+	queued++;
+}
+
+bool NullSink::empty() {
+	return pending() == 0;
+}
+
+WavSink::WavSink(const fs::Path &file) : file(file), handle(nullptr), samples(0) {}
+
+WavSink::~WavSink() {
+	close();
+}
+
+void WavSink::writeHeader() {
+	uint8_t header[wav::PCM_HEADER_SIZE];
+	wav::encode(header, AUDIO_OUTPUT_RATE, 1, samples);
+
+	fseek(handle, 0, SEEK_SET);
+	fwrite(header, 1, sizeof(header), handle);
+}
+
+void WavSink::close() {
+	if (!handle) {
+		return;
+	}
+
+	// Now that the length is known, fill it in.
+	writeHeader();
+	fclose(handle);
+	handle = nullptr;
+}
+
+bool WavSink::begin() {
+	if (handle) {
+		return true;
+	}
+
+	handle = fopen(fs::_path(file.str()).c_str(), "wb");
+	if (!handle) {
+		logger::error("Failed to open file for recording: " + file.str());
+		return false;
+	}
+
+	samples = 0;
+	writeHeader();
+	return true;
+}
+
+bool WavSink::available() {
+	return handle != nullptr;
+}
+
+uint16_t *WavSink::acquire() {
+	return buffer;
+}
+
+void WavSink::commit() {
+	int16_t pcm[dac::BUFFER_SIZE];
+	for (size_t i = 0; i < dac::BUFFER_SIZE; i++) {
+		pcm[i] = static_cast<int16_t>((buffer[i] - 2048) * 16);
+	}
+
+	if (fwrite(pcm, sizeof(int16_t), dac::BUFFER_SIZE, handle) != dac::BUFFER_SIZE) {
+		logger::error("Failed to record audio to " + file.str());
+	}
+	samples += dac::BUFFER_SIZE;
+}
+
+} // namespace audio
@@ -0,0 +1,143 @@
+/// @file sink.hpp
+#pragma once
+
+#include "../fs/path.hpp"
+#include "dac.hpp"
+#include <stdio.h>
+
+namespace audio {
+
+/**
+ * @brief A base class for something that plays (or otherwise consumes) converted DAC buffers.
+ *
+ * Buffers hold BUFFER_SIZE unsigned 12-bit samples, exactly as the DAC takes them.
+ * A sink hands out the memory for the next buffer, so samples can be converted straight into it.
+ *
+ * @see dac::setSink()
+ */
+class Sink {
+public:
+	/// Destructor.
+	virtual ~Sink() {}
+
+	/**
+	 * @brief Start the sink at AUDIO_OUTPUT_RATE.
+	 * @return True if the sink is running, false otherwise.
+	 */
+	virtual bool begin() = 0;
+
+	/**
+	 * @brief Check if the sink is ready to accept another buffer.
+	 * @return True if a buffer can be written, false otherwise.
+	 */
+	virtual bool available() = 0;
+
+	/**
+	 * @brief Get the memory to write the next buffer into.
+	 * @return Room for dac::BUFFER_SIZE 12-bit samples.
+	 * @note Only call this when available() returns true, and follow it with commit().
+	 */
+	virtual uint16_t *acquire() = 0;
+
+	/**
+	 * @brief Queue the buffer returned by acquire() to be played.
+	 */
+	virtual void commit() = 0;
+
+	/**
+	 * @brief Check if every queued buffer has been played, i.e. the sink has run dry.
+	 * @return True if nothing is left to play. Sinks that can't tell always return true.
+	 */
+	virtual bool empty() {
+		return true;
+	}
+};
+
+#ifndef EMULATE
+/**
+ * @brief A sink that plays audio through the DAC on pin A12.
+ */
+class DacSink : public Sink {
+public:
+	bool begin() override;
+	bool available() override;
+	uint16_t *acquire() override;
+	void commit() override;
+};
+#endif
+
+/**
+ * @brief A sink that throws audio away, but takes it at the same rate as the DAC would.
+ *
+ * Buffers queue up to a fixed depth like the DAC's DMA buffers do,
+ * and drain from the queue in real time once the sink has started. This way, the timing of the
+ * whole output path (including what happens when it can't keep up) can be tested without hardware.
+ */
+class NullSink : public Sink {
+	uint16_t buffer[dac::BUFFER_SIZE];
+	size_t depth;
+	bool realTime;
+	size_t queued;
+	unsigned long lastMicros;
+	uint64_t elapsed;
+
+	void drain();
+
+public:
+	/**
+	 * @brief Constructor for the NullSink class.
+	 * @param depth The number of buffers that can be queued at once.
+	 * @param realTime If false, buffers are taken as fast as they are written, e.g. for benchmarks.
+	 */
+	NullSink(size_t depth = dac::QUEUE_DEPTH, bool realTime = true);
+
+	/**
+	 * @brief Get the number of buffers waiting to be played.
+	 * @return The number of queued buffers.
+	 */
+	size_t pending();
+
+	bool begin() override;
+	bool available() override;
+	uint16_t *acquire() override;
+	void commit() override;
+	bool empty() override;
+};
+
+/**
+ * @brief A sink that records audio to a WAV file, as fast as it's written.
+ *
+ * Samples are recorded at the DAC's 12-bit resolution (scaled back up to 16-bit PCM),
+ * so the file holds exactly what would have been played.
+ */
+class WavSink : public Sink {
+	fs::Path file;
+	FILE *handle;
+	uint16_t buffer[dac::BUFFER_SIZE];
+	unsigned long samples;
+
+	void writeHeader();
+
+public:
+	/**
+	 * @brief Constructor for the WavSink class.
+	 * @param file The path to record to. Any existing file is overwritten.
+	 */
+	WavSink(const fs::Path &file);
+
+	/// Destructor. This finishes the file.
+	~WavSink();
+
+	/**
+	 * @brief Finish writing the file, so it can be read while the sink still exists.
+	 * Nothing more is recorded after this.
+	 */
+	void close();
+
+	bool begin() override;
+	bool available() override;
+	uint16_t *acquire() override;
+	void commit() override;
+};
+
+} // namespace audio
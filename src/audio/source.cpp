@@ -0,0 +1,373 @@
+#include "source.hpp"
+#include "../logger.hpp"
+#include <algorithm>
+#include <cstring>
+
+// The amount of already read data that a RequestSource keeps so it can seek backwards.
+#define REQUEST_REWIND 16384
+
+namespace audio {
+
+#ifdef FS_MMAP
+/// Whether openFile() memory maps files.
+static bool mapping = false;
+#endif
+
+FileSource::FileSource(const fs::Path &file) : FileSource(file.stream()) {}
+
+FileSource::FileSource(fs::FileStream &&stream) : stream(std::move(stream)) {
+	if (this->stream) {
+		this->stream.setReadAhead(fs::FileStream::DEFAULT_READ_AHEAD, true);
+	}
+}
+
+size_t FileSource::read(void *buffer, size_t bytes) {
+	return stream.readInto(static_cast<uint8_t *>(buffer), bytes);
+}
+
+bool FileSource::seek(size_t position) {
+	return stream.seek(position);
+}
+
+size_t FileSource::tell() const {
+	return stream.tell();
+}
+
+size_t FileSource::size() const {
+	return stream.size();
+}
+
+bool FileSource::good() const {
+	return stream.good();
+}
+
+bool FileSource::buffering() const {
+	return stream.unavailable();
+}
+
+void FileSource::prefetch() {
+	stream.prefetch();
+}
+
+MemorySource::MemorySource(const uint8_t *data, size_t length) : data(data), length(length), position(0) {}
+
+MemorySource::MemorySource(std::vector<uint8_t> &&data) : owned(std::move(data)), position(0) {
+	this->data = owned.data();
+	length = owned.size();
+}
+
+size_t MemorySource::read(void *buffer, size_t bytes) {
+	const size_t count = std::min(bytes, length - position);
+	memcpy(buffer, data + position, count);
+	position += count;
+	return count;
+}
+
+bool MemorySource::seek(size_t position) {
+	if (position > length) {
+		logger::error("Seek past the end of a memory source.");
+		return false;
+	}
+	this->position = position;
+	return true;
+}
+
+size_t MemorySource::tell() const {
+	return position;
+}
+
+size_t MemorySource::size() const {
+	return length;
+}
+
+bool MemorySource::good() const {
+	return data != nullptr || length == 0;
+}
+
+const uint8_t *MemorySource::memory() const {
+	return data;
+}
+
+#ifdef FS_MMAP
+MappedSource::MappedSource(const fs::Path &file) : stream(file.map()) {}
+
+size_t MappedSource::read(void *buffer, size_t bytes) {
+	return stream.readInto(static_cast<uint8_t *>(buffer), bytes);
+}
+
+bool MappedSource::seek(size_t position) {
+	return stream.seek(position);
+}
+
+size_t MappedSource::tell() const {
+	return stream.tell();
+}
+
+size_t MappedSource::size() const {
+	return stream.size();
+}
+
+bool MappedSource::good() const {
+	return stream.good();
+}
+
+const uint8_t *MappedSource::memory() const {
+	return stream.data();
+}
+#endif
+
+bool mapFiles(bool enable) {
+#ifdef FS_MMAP
+	mapping = enable;
+	return true;
+#else
+	if (enable) {
+		logger::warn("Memory mapped files are not supported on this platform.");
+	}
+	return !enable;
+#endif
+}
+
+Source *openFile(const fs::Path &file) {
+#ifdef FS_MMAP
+	if (mapping) {
+		return new MappedSource(file);
+	}
+#endif
+	return new FileSource(file);
+}
+
+RequestSource::RequestSource(net::Request &&request) : request(std::move(request)), bufferStart(0), position(0) {}
+
+bool RequestSource::receive() {
+	if (request.done() && !request.ready()) {
+		return false;
+	}
+
+	std::vector<uint8_t> data = request.stream();
+	if (data.empty()) {
+		return false;
+	}
+
+	// Drop anything that's too far behind the read position to be seeked back to.
+	const size_t keepFrom = position > REQUEST_REWIND ? position - REQUEST_REWIND : 0;
+	if (keepFrom > bufferStart) {
+		const size_t drop = std::min(keepFrom - bufferStart, buffer.size());
+		buffer.erase(buffer.begin(), buffer.begin() + drop);
+		bufferStart += drop;
+	}
+
+	buffer.insert(buffer.end(), data.begin(), data.end());
+	return true;
+}
+
+size_t RequestSource::read(void *buffer, size_t bytes) {
+	uint8_t *out = static_cast<uint8_t *>(buffer);
+	size_t count = 0;
+
+	while (count < bytes) {
+		const size_t bufferEnd = bufferStart + this->buffer.size();
+		if (position < bufferEnd) {
+			const size_t n = std::min(bytes - count, bufferEnd - position);
+			memcpy(out + count, this->buffer.data() + (position - bufferStart), n);
+			position += n;
+			count += n;
+		} else if (!receive()) {
+			break;
+		}
+	}
+
+	return count;
+}
+
+bool RequestSource::seek(size_t position) {
+	if (position < bufferStart) {
+		logger::error("Cannot seek back that far in a network stream.");
+		return false;
+	}
+
+	// Skip forward by receiving data until the position is buffered.
+	while (position > bufferStart + buffer.size()) {
+		this->position = bufferStart + buffer.size();
+		if (!receive()) {
+			logger::error("Seek past the end of a network stream.");
+			return false;
+		}
+	}
+
+	this->position = position;
+	return true;
+}
+
+size_t RequestSource::tell() const {
+	return position;
+}
+
+size_t RequestSource::size() const {
+	const uint64_t length = request.length();
+	return length == (uint64_t)-1 ? 0 : length;
+}
+
+bool RequestSource::good() const {
+	return request.ok();
+}
+
+bool RequestSource::seekable() const {
+	return false;
+}
+
+GrowingFileSource::GrowingFileSource(const fs::Path &file, size_t expected) : stream(file.stream()), available(0), expected(expected), position(0), complete(false), starved(false) {
+	// Only one buffer, since the block after the one being read usually hasn't been written yet.
+	// Nothing past the written data is read, since the file may have been preallocated.
+	if (stream) {
+		stream.setReadAhead();
+		stream.setReadLimit(0);
+	}
+}
+
+void GrowingFileSource::extend(size_t bytes) {
+	if (bytes > available) {
+		available = bytes;
+		starved = false;
+		stream.setReadLimit(available);
+	}
+}
+
+void GrowingFileSource::finish() {
+	if (complete) {
+		return;
+	}
+
+	finish(std::max(available, stream.refreshSize()));
+}
+
+void GrowingFileSource::finish(size_t bytes) {
+	if (complete) {
+		return;
+	}
+
+	complete = true;
+	available = bytes;
+	expected = available;
+	starved = false;
+	stream.setReadLimit(available);
+}
+
+bool GrowingFileSource::buffering() const {
+	return starved || stream.unavailable();
+}
+
+size_t GrowingFileSource::read(void *buffer, size_t bytes) {
+	if (!complete && available != expected && bytes > available - std::min(position, available)) {
+		starved = true;
+	}
+
+	if (position >= available) {
+		return 0;
+	}
+
+	// Re-seek before every read, since a previous short read may have left the stream at EOF
+	// and the writer has appended to the file since.
+	if (!stream.seek(position)) {
+		return 0;
+	}
+
+	const size_t count = stream.readInto(static_cast<uint8_t *>(buffer), std::min(bytes, available - position));
+	position += count;
+	return count;
+}
+
+bool GrowingFileSource::seek(size_t position) {
+	if (expected && position > expected) {
+		logger::error("Seek past the end of a growing file.");
+		return false;
+	}
+	this->position = position;
+	return true;
+}
+
+size_t GrowingFileSource::tell() const {
+	return position;
+}
+
+size_t GrowingFileSource::size() const {
+	return expected;
+}
+
+bool GrowingFileSource::good() const {
+	return stream.good();
+}
+
+void GrowingFileSource::retarget(const fs::Path &file) {
+	stream.retarget(file.str());
+}
+
+size_t GrowingFileSource::written() const {
+	return available;
+}
+
+/// Get the expected size of a download, if the server sent one.
+static size_t downloadLength(const util::DownloadQueue &queue, int id) {
+	const util::Download *download = queue.get(id);
+	if (!download) {
+		return 0;
+	}
+
+	const uint64_t length = download->request.length();
+	return length == (uint64_t)-1 ? 0 : length;
+}
+
+/// Get the file a download is being written to, which is only renamed to its final path once complete.
+static fs::Path downloadPath(const util::DownloadQueue &queue, int id, const fs::Path &file) {
+	const util::Download *download = queue.get(id);
+	return download && !download->complete ? download->partial : file;
+}
+
+DownloadSource::DownloadSource(const util::DownloadQueue &queue, int id, const fs::Path &file) : GrowingFileSource(downloadPath(queue, id, file), downloadLength(queue, id)), queue(queue), id(id), file(file), settled(false) {
+	refresh();
+}
+
+void DownloadSource::refresh() {
+	if (settled) {
+		return;
+	}
+
+	const util::Download *download = queue.get(id);
+	if (download) {
+		extend(download->written);
+		if (download->complete) {
+			settle(download->succeeded, download->written);
+		}
+		return;
+	}
+
+	// The download has been cleaned up from the queue. The partial file's size can't be trusted, since it was
+	// preallocated and may already have been removed, so go by what the queue remembers.
+	const util::DownloadOutcome *outcome = queue.outcome(id);
+	if (outcome) {
+		settle(outcome->succeeded, outcome->written);
+	} else {
+		// It ended too long ago to be remembered, so only a file at the destination shows that it succeeded.
+		file.invalidate();
+		const bool succeeded = file.isFile();
+		settle(succeeded, succeeded ? file.size() : written());
+	}
+}
+
+/// Let the source know that the download has ended, and how.
+void DownloadSource::settle(bool succeeded, uint64_t bytes) {
+	settled = true;
+	finish(bytes);
+
+	// The partial file the stream has open has been renamed, so reopen it by its new name after a remount.
+	if (succeeded) {
+		retarget(file);
+	}
+}
+
+size_t DownloadSource::read(void *buffer, size_t bytes) {
+	refresh();
+	return GrowingFileSource::read(buffer, bytes);
+}
+
+} // namespace audio
@@ -0,0 +1,322 @@
+/// @file source.hpp
+#pragma once
+
+#include "../fs/fileStream.hpp"
+#include "../fs/path.hpp"
+#include "../net/request.hpp"
+#include "../util/downloadQueue.hpp"
+#include <vector>
+
+namespace audio {
+
+/**
+ * @brief A base class for anything that audio data can be read from.
+ * Decoders only ever read through this interface, so they can be fed from files,
+ * memory or the network without copying the data through intermediate buffers.
+ */
+class Source {
+public:
+	/// Destructor.
+	virtual ~Source() {}
+
+	/**
+	 * @brief Read data from the source into caller-supplied memory.
+	 * @param buffer The buffer to read into.
+	 * @param bytes The maximum number of bytes to read.
+	 * @return The number of bytes read. This is only less than `bytes` at the end of the data.
+	 */
+	virtual size_t read(void *buffer, size_t bytes) = 0;
+
+	/**
+	 * @brief Seek to a specific position in the data.
+	 * @param position The byte offset to seek to.
+	 * @return True if the seek was successful, false otherwise.
+	 * @note Not every source can seek backwards, see RequestSource.
+	 */
+	virtual bool seek(size_t position) = 0;
+
+	/**
+	 * @brief Get the current position in the data.
+	 * @return The byte offset of the next read.
+	 */
+	virtual size_t tell() const = 0;
+
+	/**
+	 * @brief Get the total size of the data.
+	 * @return The size in bytes, or 0 if unknown.
+	 */
+	virtual size_t size() const = 0;
+
+	/**
+	 * @brief Check if the source is in a good state.
+	 * @return True if the source is good, false otherwise.
+	 */
+	virtual bool good() const = 0;
+
+	/**
+	 * @brief Check if the source can seek freely, including backwards.
+	 * @return True if any position can be seeked to, false otherwise.
+	 */
+	virtual bool seekable() const {
+		return true;
+	}
+
+	/**
+	 * @brief Check if a read came up short because the data hasn't arrived yet, rather than because it ended.
+	 * @return True if waiting for more data, false otherwise.
+	 */
+	virtual bool buffering() const {
+		return false;
+	}
+
+	/**
+	 * @brief Get direct access to all of the data, if the source holds it in memory.
+	 * Decoders can then work on the data in place, rather than copying it out with read().
+	 * @return A pointer to the first of size() bytes, valid for the life of the source, or nullptr if the data isn't in memory.
+	 */
+	virtual const uint8_t *memory() const {
+		return nullptr;
+	}
+
+	/**
+	 * @brief Fetch upcoming data ahead of time, so that later reads don't have to wait for it.
+	 * This should be called from the main loop when there's time to spare. By default it does nothing.
+	 */
+	virtual void prefetch() {}
+
+	/**
+	 * @brief Check if the source is in a good state.
+	 * @return True if the source is good, false otherwise.
+	 */
+	inline operator bool() const {
+		return good();
+	}
+};
+
+/**
+ * @brief A source that reads from a file on the USB drive.
+ * The file is read ahead in cluster-aligned blocks with double-buffering,
+ * so decoders' small reads come from RAM and prefetch() can load the next block outside the playback path.
+ * If the USB drive drops out, the source is buffering until it has been remounted, and then carries on where it was.
+ */
+class FileSource : public Source {
+	fs::FileStream stream;
+
+public:
+	/**
+	 * @brief Constructor for the FileSource class.
+	 * @param file The path of the file to read.
+	 */
+	FileSource(const fs::Path &file);
+
+	/**
+	 * @brief Constructor for the FileSource class, taking over a stream that is already open.
+	 * @param stream The stream to read. Reading carries on from its current position.
+	 */
+	FileSource(fs::FileStream &&stream);
+
+	size_t read(void *buffer, size_t bytes) override;
+	bool seek(size_t position) override;
+	size_t tell() const override;
+	size_t size() const override;
+	bool good() const override;
+	bool buffering() const override;
+	void prefetch() override;
+};
+
+/**
+ * @brief A source that reads from a buffer in memory.
+ */
+class MemorySource : public Source {
+	std::vector<uint8_t> owned;
+	const uint8_t *data;
+	size_t length;
+	size_t position;
+
+public:
+	/**
+	 * @brief Construct a source that reads from memory owned by the caller.
+	 * @param data The data to read. This must outlive the source.
+	 * @param length The length of the data in bytes.
+	 */
+	MemorySource(const uint8_t *data, size_t length);
+
+	/**
+	 * @brief Construct a source that takes ownership of a buffer.
+	 * @param data The data to read.
+	 */
+	MemorySource(std::vector<uint8_t> &&data);
+
+	size_t read(void *buffer, size_t bytes) override;
+	bool seek(size_t position) override;
+	size_t tell() const override;
+	size_t size() const override;
+	bool good() const override;
+	const uint8_t *memory() const override;
+};
+
+#ifdef FS_MMAP
+/**
+ * @brief A source that reads a memory-mapped file, when emulating on a POSIX host.
+ * Decoders read straight out of the page cache through memory(), with no stdio or read-ahead buffers in between.
+ */
+class MappedSource : public Source {
+	fs::MappedStream stream;
+
+public:
+	/**
+	 * @brief Constructor for the MappedSource class.
+	 * @param file The path of the file to read.
+	 */
+	MappedSource(const fs::Path &file);
+
+	size_t read(void *buffer, size_t bytes) override;
+	bool seek(size_t position) override;
+	size_t tell() const override;
+	size_t size() const override;
+	bool good() const override;
+	const uint8_t *memory() const override;
+};
+#endif
+
+/**
+ * @brief A source that reads the body of a network request as it arrives.
+ *
+ * Data is read straight from the request, so seeking forwards just skips data.
+ * The most recently received data is kept so that decoders can seek back a short way
+ * (e.g. after probing the format of the file), but seeking back any further will fail.
+ */
+class RequestSource : public Source {
+	net::Request request;
+	std::vector<uint8_t> buffer;
+	size_t bufferStart;
+	size_t position;
+
+	bool receive();
+
+public:
+	/**
+	 * @brief Constructor for the RequestSource class.
+	 * @param request The request to read the response body of.
+	 */
+	RequestSource(net::Request &&request);
+
+	size_t read(void *buffer, size_t bytes) override;
+	bool seek(size_t position) override;
+	size_t tell() const override;
+	size_t size() const override;
+	bool good() const override;
+	bool seekable() const override;
+};
+
+/**
+ * @brief A source that reads from a file that is still being written, e.g. a download in progress.
+ *
+ * Reads never go past the amount of data known to be written.
+ * If a read catches up with the writer, it returns early and buffering() becomes true,
+ * rather than treating it as the end of the file.
+ */
+class GrowingFileSource : public Source {
+	fs::FileStream stream;
+	size_t available;
+	size_t expected;
+	size_t position;
+	bool complete;
+	bool starved;
+
+protected:
+	/**
+	 * @brief Let the source know that the file has been renamed, so it can still be found if the drive is remounted.
+	 * @param file The file's new path.
+	 */
+	void retarget(const fs::Path &file);
+
+	/**
+	 * @brief Get the amount of data known to be written so far.
+	 * @return The number of bytes that are safe to read.
+	 */
+	size_t written() const;
+
+public:
+	/**
+	 * @brief Constructor for the GrowingFileSource class.
+	 * @param file The path of the file to read.
+	 * @param expected The final size of the file in bytes, or 0 if unknown.
+	 */
+	GrowingFileSource(const fs::Path &file, size_t expected = 0);
+
+	/**
+	 * @brief Let the source know that more data has been written.
+	 * @param bytes The total number of bytes now written to the file.
+	 */
+	void extend(size_t bytes);
+
+	/**
+	 * @brief Let the source know that the file is complete.
+	 * After this, reaching the end of the written data is the end of the file.
+	 */
+	void finish();
+
+	/**
+	 * @brief Let the source know that the file is complete, and exactly how long it is.
+	 * Use this when the file may be longer than its data, e.g. if it was preallocated.
+	 * @param bytes The total number of bytes written to the file.
+	 */
+	void finish(size_t bytes);
+
+	/**
+	 * @brief Check if a read has run out of written data before the end of the file.
+	 * This stays true until more data is written. It is also true while the USB drive is temporarily unavailable.
+	 * @return True if waiting on the writer or the drive, false otherwise.
+	 */
+	bool buffering() const override;
+
+	size_t read(void *buffer, size_t bytes) override;
+	bool seek(size_t position) override;
+	size_t tell() const override;
+	size_t size() const override;
+	bool good() const override;
+};
+
+/**
+ * @brief A source that plays a file while a DownloadQueue is still downloading it.
+ * The amount of data that is safe to read is picked up from the queue before every read.
+ * While the download is in progress, this reads the download's `.part` file, which keeps working once it's renamed.
+ */
+class DownloadSource : public GrowingFileSource {
+	const util::DownloadQueue &queue;
+	int id;
+	fs::Path file;
+	bool settled;
+
+	void refresh();
+	void settle(bool succeeded, uint64_t bytes);
+
+public:
+	/**
+	 * @brief Constructor for the DownloadSource class.
+	 * @param queue The download queue that is writing the file. This must outlive the source.
+	 * @param id The unique identifier for the download.
+	 * @param file The destination file path of the download.
+	 */
+	DownloadSource(const util::DownloadQueue &queue, int id, const fs::Path &file);
+
+	size_t read(void *buffer, size_t bytes) override;
+};
+
+/**
+ * @brief Choose how openFile() reads files: through a FileStream, or by memory mapping them.
+ * Mapping is only available when emulating on a POSIX host (see FS_MMAP), e.g. for benchmarking or running on Linux.
+ * @param enable True to memory map files, false to read them through a FileStream.
+ * @return True if the choice was applied, false if memory mapping isn't available.
+ */
+bool mapFiles(bool enable);
+
+/**
+ * @brief Open a complete file to play, reading it the way chosen with mapFiles().
+ * @param file The path of the file to read.
+ * @return A new source, which the caller owns.
+ */
+Source *openFile(const fs::Path &file);
+
+} // namespace audio
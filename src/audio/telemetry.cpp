@@ -0,0 +1,66 @@
+#include "telemetry.hpp"
+#include "../logger.hpp"
+#include <Arduino.h>
+
+namespace audio {
+
+namespace telemetry {
+
+static Stats current = {};
+static unsigned long pendingDecode = 0;
+static bool queueFilled = false;
+
+const Stats &stats() {
+	return current;
+}
+
+void reset() {
+	current = {};
+	pendingDecode = 0;
+	queueFilled = false;
+}
+
+void print() {
+	logger::info("Audio: " + String(current.buffers) + " buffers, " + String(current.underruns) + " underruns, " + String(current.stalls) + " stalls, queue " + String((unsigned long)current.queueDepth) + " (min " + String((unsigned long)current.minQueueDepth) + "), refill " + String(current.refillMicros) + " us (peak " + String(current.refillPeakMicros) + "), decode " + String(current.decodeMicros) + " us (peak " + String(current.decodePeakMicros) + ")");
+}
+
+void decoded(unsigned long micros) {
+	pendingDecode += micros;
+}
+
+void refilled(unsigned long micros) {
+	current.buffers++;
+
+	current.refillMicros = (current.refillMicros * 7 + micros) / 8;
+	if (micros > current.refillPeakMicros) {
+		current.refillPeakMicros = micros;
+	}
+
+	current.decodeMicros = (current.decodeMicros * 7 + pendingDecode) / 8;
+	if (pendingDecode > current.decodePeakMicros) {
+		current.decodePeakMicros = pendingDecode;
+	}
+	pendingDecode = 0;
+}
+
+void queued(size_t depth, bool full) {
+	current.queueDepth = depth;
+
+	// The queue is bound to start out shallow, so only watch for dips once it has filled.
+	if (full && (depth < current.minQueueDepth || !queueFilled)) {
+		current.minQueueDepth = depth;
+		queueFilled = true;
+	}
+}
+
+void underrun() {
+	current.underruns++;
+}
+
+void stall() {
+	current.stalls++;
+}
+
+} // namespace telemetry
+
+} // namespace audio
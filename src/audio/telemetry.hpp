@@ -0,0 +1,89 @@
+/// @file telemetry.hpp
+#pragma once
+
+#include <stddef.h>
+
+namespace audio {
+
+/**
+ * @brief Playback health metrics, for tuning buffer sizes from real data.
+ *
+ * The output path reports into here as it goes. Underruns (the DAC running dry because
+ * a buffer wasn't ready in time) are counted separately from stalls (a download not keeping up),
+ * and neither is confused with the end of a track.
+ */
+namespace telemetry {
+
+/**
+ * @brief A snapshot of the playback metrics.
+ * Averages are smoothed over roughly the last 8 buffers. Peaks and counts are since the last reset().
+ */
+struct Stats {
+	/// The number of buffers written to the DAC.
+	unsigned long buffers;
+	/// The number of times the DAC ran out of audio because the next buffer was late.
+	unsigned long underruns;
+	/// The number of buffers padded with silence because the source was still buffering.
+	unsigned long stalls;
+	/// The estimated number of buffers queued in the DAC after the last write.
+	size_t queueDepth;
+	/// The lowest queue depth seen since the queue first filled up.
+	size_t minQueueDepth;
+	/// The average time to produce and write one buffer, in microseconds.
+	unsigned long refillMicros;
+	/// The longest time taken to produce and write one buffer, in microseconds.
+	unsigned long refillPeakMicros;
+	/// The average time spent decoding per buffer, in microseconds.
+	unsigned long decodeMicros;
+	/// The longest time spent decoding for one buffer, in microseconds.
+	unsigned long decodePeakMicros;
+};
+
+/**
+ * @brief Get the current playback metrics.
+ * @return The metrics.
+ */
+const Stats &stats();
+
+/**
+ * @brief Reset every metric.
+ */
+void reset();
+
+/**
+ * @brief Log a summary of the metrics.
+ */
+void print();
+
+/**
+ * @brief Record time spent decoding. This is attributed to the next buffer written.
+ * @param micros The time taken in microseconds.
+ */
+void decoded(unsigned long micros);
+
+/**
+ * @brief Record that a buffer was written.
+ * @param micros The time taken to produce and write the buffer, in microseconds.
+ */
+void refilled(unsigned long micros);
+
+/**
+ * @brief Record the estimated DAC queue depth after a write.
+ * @param depth The number of queued buffers.
+ * @param full Whether the queue has filled up since playback started.
+ */
+void queued(size_t depth, bool full);
+
+/**
+ * @brief Record that the DAC ran dry.
+ */
+void underrun();
+
+/**
+ * @brief Record that a buffer was padded with silence while the source was buffering.
+ */
+void stall();
+
+} // namespace telemetry
+
+} // namespace audio
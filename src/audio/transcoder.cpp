@@ -0,0 +1,279 @@
+#include "transcoder.hpp"
+#include "header.hpp"
+#include "../util/hash.hpp"
+#include <Arduino.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+// The extension of a decoded file that has not been finished yet.
+#define TRANSCODE_PARTIAL_EXT ".part"
+
+namespace audio {
+
+constexpr unsigned long Transcoder::SLICE_MICROS;
+
+/// Check if a file name is one that cacheName() gives, i.e. 8 hex digits followed by ".wav".
+static bool decodedName(const String &name) {
+	if (name.length() != 12 || !name.endsWith(".wav")) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < 8; i++) {
+		if (!isxdigit(static_cast<unsigned char>(name[i]))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+Transcoder::Transcoder(const fs::Path &directory, uint64_t budget) : directory(directory), budget(budget), clock(0), statistics{}, source(nullptr), decoder(nullptr), output(nullptr), chunkSize(0), chunkOffset(0), channels(0), finishing(false), samples(0) {
+	if (!directory.mkdir(true)) {
+		logger::error("Failed to create transcode directory: " + directory.str());
+		return;
+	}
+
+	// Pick up files decoded in earlier sessions, and clear out any that were interrupted.
+	// Anything else in the directory isn't ours, so it is left alone and not counted towards the budget.
+	for (const fs::Path &file : directory) {
+		const String name = file.name();
+		if (name.endsWith(TRANSCODE_PARTIAL_EXT) && decodedName(name.substring(0, name.length() - strlen(TRANSCODE_PARTIAL_EXT)))) {
+			file.unlink();
+			continue;
+		}
+
+		if (!decodedName(name)) {
+			continue;
+		}
+
+		const int size = file.size();
+		if (size > 0) {
+			entries.push_back({name, static_cast<unsigned long>(size), 0});
+			statistics.storedBytes += size;
+		}
+	}
+}
+
+Transcoder::~Transcoder() {
+	if (decoder) {
+		finish(false);
+	}
+}
+
+String Transcoder::cacheName(const fs::Path &file) {
+	// The same song always maps to the same file.
+	const uint32_t hash = fnv1a32(file.c_str(), file.str().length());
+
+	char name[16];
+	snprintf(name, sizeof(name), "%08lx.wav", static_cast<unsigned long>(hash));
+	return String(name);
+}
+
+Transcoder::Entry *Transcoder::find(const String &name) {
+	for (Entry &entry : entries) {
+		if (entry.name == name) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+void Transcoder::add(const fs::Path &file) {
+	const String name = cacheName(file);
+	if (find(name) || (decoder && outputName == name)) {
+		return;
+	}
+
+	for (const fs::Path &queued : pending) {
+		if (queued.str() == file.str()) {
+			return;
+		}
+	}
+
+	pending.push_back(file);
+}
+
+fs::Path Transcoder::lookup(const fs::Path &file) {
+	const String name = cacheName(file);
+	Entry *entry = find(name);
+	if (!entry) {
+		return file;
+	}
+
+	const fs::Path decoded = directory / name;
+	if (!decoded.isFile()) {
+		// Removed behind our back, so forget about it.
+		statistics.storedBytes -= entry->size;
+		entries.erase(entries.begin() + (entry - entries.data()));
+		return file;
+	}
+
+	entry->used = ++clock;
+	return decoded;
+}
+
+bool Transcoder::reserve(uint64_t bytes) {
+	if (bytes > budget) {
+		return false;
+	}
+
+	while (statistics.storedBytes + bytes > budget && !entries.empty()) {
+		// Remove the least recently used file.
+		size_t oldest = 0;
+		for (size_t i = 1; i < entries.size(); i++) {
+			if (entries[i].used < entries[oldest].used) {
+				oldest = i;
+			}
+		}
+
+		(directory / entries[oldest].name).unlink();
+		statistics.storedBytes -= entries[oldest].size;
+		statistics.evictions++;
+		entries.erase(entries.begin() + oldest);
+	}
+
+	return true;
+}
+
+bool Transcoder::writeHeader() {
+	uint8_t header[wav::PCM_HEADER_SIZE];
+	wav::encode(header, AUDIO_OUTPUT_RATE, 1, samples);
+
+	return fseek(output, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), output) == sizeof(header);
+}
+
+bool Transcoder::open() {
+	while (!pending.empty()) {
+		const fs::Path file = pending.front();
+		pending.erase(pending.begin());
+
+		outputName = cacheName(file);
+		if (find(outputName)) {
+			continue;
+		}
+
+		source = openFile(file);
+		decoder = *source ? Decoder::open(*source) : nullptr;
+		if (!decoder) {
+			logger::error("Failed to open song to transcode: " + file.str());
+			delete source;
+			source = nullptr;
+			continue;
+		}
+
+		// Make room for the whole decoded file up front, so the budget is never exceeded.
+		const uint64_t outputSamples = static_cast<uint64_t>(decoder->frames()) * AUDIO_OUTPUT_RATE / decoder->sampleRate();
+		if (!reserve(wav::PCM_HEADER_SIZE + outputSamples * sizeof(int16_t))) {
+			logger::info("Song is too large to transcode: " + file.str());
+			delete decoder;
+			delete source;
+			decoder = nullptr;
+			source = nullptr;
+			continue;
+		}
+
+		const fs::Path partial = directory / (outputName + TRANSCODE_PARTIAL_EXT);
+		output = fopen(fs::_path(partial.str()).c_str(), "wb");
+		samples = 0;
+		if (!output || !writeHeader()) {
+			logger::error("Failed to create transcoded file: " + partial.str());
+			finish(false);
+			continue;
+		}
+
+		channels = decoder->channels();
+		resampler = Resampler(decoder->sampleRate(), channels);
+		chunk.resize(Resampler::BLOCK * channels);
+		chunkSize = 0;
+		chunkOffset = 0;
+		finishing = false;
+		statistics.inputBytes += source->size();
+		return true;
+	}
+
+	return false;
+}
+
+void Transcoder::finish(bool success) {
+	const fs::Path partial = directory / (outputName + TRANSCODE_PARTIAL_EXT);
+
+	if (output) {
+		success = writeHeader() && success;
+		fclose(output);
+		output = nullptr;
+	}
+
+	const fs::Path decoded = directory / outputName;
+	if (success && partial.rename(decoded, true)) {
+		const unsigned long size = wav::PCM_HEADER_SIZE + samples * sizeof(int16_t);
+		entries.push_back({outputName, size, ++clock});
+		statistics.songs++;
+		statistics.storedBytes += size;
+		statistics.outputBytes += size;
+	} else if (partial.exists()) {
+		partial.unlink();
+	}
+
+	delete decoder;
+	delete source;
+	decoder = nullptr;
+	source = nullptr;
+}
+
+bool Transcoder::process(unsigned long sliceMicros) {
+	const unsigned long start = micros();
+
+	while (micros() - start < sliceMicros) {
+		if (!decoder && !open()) {
+			break;
+		}
+
+		int16_t out[Resampler::BLOCK];
+		const size_t count = resampler.read(out, Resampler::BLOCK);
+		if (count) {
+			if (fwrite(out, sizeof(int16_t), count, output) != count) {
+				logger::error("Failed to write transcoded file: " + outputName);
+				finish(false);
+				continue;
+			}
+			samples += count;
+			statistics.samples += count;
+			continue;
+		}
+
+		if (chunkOffset >= chunkSize) {
+			if (finishing) {
+				finish(true);
+				continue;
+			}
+
+			chunkSize = decoder->read(chunk.data(), Resampler::BLOCK) * channels;
+			chunkOffset = 0;
+			if (!chunkSize) {
+				resampler.flush();
+				finishing = true;
+				continue;
+			}
+		}
+
+		chunkOffset += resampler.write(chunk.data() + chunkOffset, (chunkSize - chunkOffset) / channels) * channels;
+	}
+
+	statistics.micros += micros() - start;
+	return decoder || !pending.empty();
+}
+
+const Transcoder::Stats &Transcoder::stats() const {
+	return statistics;
+}
+
+void Transcoder::print() const {
+	const Stats &s = statistics;
+	const float expansion = s.inputBytes ? static_cast<float>(s.outputBytes) / s.inputBytes : 0.0f;
+	const float audioSeconds = static_cast<float>(s.samples) / AUDIO_OUTPUT_RATE;
+	const float load = audioSeconds > 0.0f ? s.micros / (audioSeconds * 1e6f) * 100.0f : 0.0f;
+
+	logger::info("Transcode: " + String(s.songs) + " songs, " + String(static_cast<unsigned long>(s.inputBytes / 1024)) + " KB in, " + String(static_cast<unsigned long>(s.outputBytes / 1024)) + " KB out (" + String(expansion, 1) + "x), " + String(load, 1) + "% of real time saved on replay, " + String(static_cast<unsigned long>(s.storedBytes / 1024)) + "/" + String(static_cast<unsigned long>(budget / 1024)) + " KB stored, " + String(s.evictions) + " evictions");
+}
+
+} // namespace audio
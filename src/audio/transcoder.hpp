@@ -0,0 +1,136 @@
+/// @file transcoder.hpp
+#pragma once
+
+#include "decoder.hpp"
+#include "resampler.hpp"
+#include <vector>
+
+namespace audio {
+
+/**
+ * @brief A background worker that decodes cached songs ahead of time.
+ *
+ * Decoding compressed audio while it plays competes with the network and UI for CPU time.
+ * When the kiosk is otherwise idle, songs that have already been downloaded are decoded, resampled and mixed down
+ * into the DAC's native format (mono 16-bit PCM at AUDIO_OUTPUT_RATE), so that playing them again later
+ * skips decoding and resampling entirely.
+ *
+ * The work is split into small time slices, so it can run from the main loop between DAC buffers without causing underruns.
+ * Decoded files are several times larger than the compressed originals, so they are kept under a byte budget,
+ * and the least recently used files are removed to make room for new ones.
+ */
+class Transcoder {
+public:
+	/// The default time to spend per call to process(), in microseconds. This is well under one DAC buffer.
+	static constexpr unsigned long SLICE_MICROS = 2000;
+
+	/**
+	 * @brief A summary of the work done, for weighing CPU time saved against storage used.
+	 */
+	struct Stats {
+		/// The number of songs decoded.
+		unsigned long songs;
+		/// The number of decoded songs removed to stay under the budget.
+		unsigned long evictions;
+		/// The total size of the songs decoded, in bytes.
+		uint64_t inputBytes;
+		/// The total size of the decoded files written, in bytes.
+		uint64_t outputBytes;
+		/// The size of the decoded files currently stored, in bytes.
+		uint64_t storedBytes;
+		/// The total number of samples written.
+		uint64_t samples;
+		/// The total time spent decoding and writing, in microseconds.
+		uint64_t micros;
+	};
+
+private:
+	/// A decoded file in the cache directory.
+	struct Entry {
+		String name;
+		unsigned long size;
+		unsigned long used;
+	};
+
+	fs::Path directory;
+	uint64_t budget;
+	std::vector<Entry> entries;
+	std::vector<fs::Path> pending;
+	unsigned long clock;
+	Stats statistics;
+
+	// The song currently being decoded.
+	Source *source;
+	Decoder *decoder;
+	FILE *output;
+	String outputName;
+	Resampler resampler;
+	std::vector<int16_t> chunk;
+	size_t chunkSize;
+	size_t chunkOffset;
+	unsigned int channels;
+	bool finishing;
+	unsigned long samples;
+
+	static String cacheName(const fs::Path &file);
+	Entry *find(const String &name);
+	bool open();
+	void finish(bool success);
+	bool reserve(uint64_t bytes);
+	bool writeHeader();
+
+public:
+	/**
+	 * @brief Constructor for the Transcoder class.
+	 * Any decoded files already in the directory are counted towards the budget, and unfinished ones are removed.
+	 * Other files in the directory are left alone, and do not count towards the budget.
+	 * @param directory The directory to store decoded files in. It is created if it does not exist.
+	 * @param budget The maximum total size of the decoded files, in bytes.
+	 */
+	Transcoder(const fs::Path &directory, uint64_t budget);
+
+	/// Destructor. A partially decoded song is discarded.
+	~Transcoder();
+
+	Transcoder(const Transcoder &) = delete;
+	Transcoder &operator=(const Transcoder &) = delete;
+
+	/**
+	 * @brief Queue a downloaded song to be decoded.
+	 * @param file The song to decode. This must be complete, not still downloading.
+	 * @note Songs that have already been decoded, or are already queued, are ignored.
+	 */
+	void add(const fs::Path &file);
+
+	/**
+	 * @brief Get the file to play for a song.
+	 * This also marks the decoded file as recently used, so it is the last to be removed.
+	 * @param file The original song.
+	 * @return The decoded file if there is one, otherwise the original song.
+	 */
+	fs::Path lookup(const fs::Path &file);
+
+	/**
+	 * @brief Do a slice of decoding work.
+	 * @param sliceMicros How long to work for before returning, in microseconds.
+	 * @return True if there is more work to do, false if the queue is empty.
+	 * @note This should be called from the main loop after the audio output has been refilled,
+	 * so the DAC has a full queue to play from while the slice runs.
+	 */
+	bool process(unsigned long sliceMicros = SLICE_MICROS);
+
+	/**
+	 * @brief Get a summary of the work done so far.
+	 * @return The statistics.
+	 */
+	const Stats &stats() const;
+
+	/**
+	 * @brief Log the decode and storage trade-offs so far.
+	 * This includes how much larger the decoded files are than the originals,
+	 * and how much CPU time playing them saves, as a fraction of real time.
+	 */
+	void print() const;
+};
+
+} // namespace audio
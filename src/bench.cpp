@@ -0,0 +1,19 @@
+#include "bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+namespace bench {
+
+void run() {
+	resampler();
+	mp3();
+	pipeline();
+	sources();
+	writes();
+	cache();
+	store();
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,93 @@
+/// @file bench.hpp
+#pragma once
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include <Arduino.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Host-side benchmarks, only built when emulating with `BENCHMARK` defined.
+ * Results are printed to the console.
+ */
+namespace bench {
+
+/**
+ * @brief Get a high-resolution timestamp.
+ * @return The current time in nanoseconds.
+ */
+inline uint64_t nanos() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Get the CPU cycle counter, if the host has one.
+ * @return The current cycle count, or 0 if not supported.
+ */
+inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief Run every benchmark.
+ */
+void run();
+
+/**
+ * @brief Measure the cost of the audio resampler per output sample,
+ * and check its accuracy against a floating-point reference.
+ */
+void resampler();
+
+/**
+ * @brief Measure MP3 decode throughput and seek latency, using `bench.mp3` from the root of the USB drive.
+ */
+void mp3();
+
+/**
+ * @brief Measure the whole audio output path (decode, resample, gain and 12-bit conversion) for a range of WAV formats.
+ * The WAV fixtures are generated in `/bench` on the USB drive the first time this runs.
+ * Reports throughput, per-buffer latency percentiles and heap allocations per buffer.
+ */
+void pipeline();
+
+/**
+ * @brief Compare decoding whole files read through a FileStream (stdio with read-ahead) against a memory mapping.
+ * Uses the WAV fixtures in `/bench` from pipeline(), and `bench.mp3` if there is one.
+ */
+void sources();
+
+/**
+ * @brief Compare ways of writing a file that arrives in small chunks, as downloads do:
+ * reopening the file for every chunk, keeping it open with stdio buffering, and a FileWriter, with and without
+ * a background worker. Reports throughput, the longest single chunk write, file opens and fwrite calls for each.
+ * On the host the page cache hides most of the cost of writes, so the counts say more about the USB drive
+ * than the throughput does, and the worker has no slow writes to hide.
+ */
+void writes();
+
+/**
+ * @brief Measure how file open and insert latency grow with the number of cached files,
+ * for one flat directory against a sharded fs::Cache, up to 10,000 entries.
+ * Also reports the largest directory in each layout. Most host filesystems index large directories,
+ * so the flat layout slows down far less there than on FAT, where every lookup is a linear scan.
+ */
+void cache();
+
+/**
+ * @brief Compare updating one value in a JSON file, which means rewriting the whole file,
+ * against appending it to an fs::Store. Also times reading the JSON back against opening the store and looking up every key.
+ */
+void store();
+
+} // namespace bench
+
+#endif
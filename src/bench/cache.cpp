@@ -0,0 +1,106 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../fs/cache.hpp"
+#include "../logger.hpp"
+#include <vector>
+
+/// The number of entries the cache grows to.
+#define CACHE_ENTRIES 10000
+
+/// The number of files opened at each size, to average the open latency over.
+#define CACHE_OPENS 1000
+
+namespace bench {
+
+/// The cache sizes to measure open latency at.
+static const unsigned long checkpoints[] = {100, 1000, 2500, 5000, CACHE_ENTRIES};
+
+/// Get the key of the nth entry.
+static String key(unsigned long n) {
+	return "song-" + String(n);
+}
+
+/// Open and close a file, as the player does when starting a song.
+static bool touch(const fs::Path &file) {
+	FILE *handle = fopen(fs::_path(file.str()).c_str(), "rb");
+	if (!handle) {
+		return false;
+	}
+	fclose(handle);
+	return true;
+}
+
+void cache() {
+	const fs::Path flat("/bench/flat");
+	const fs::Path sharded("/bench/cache");
+	fs::Path("/bench").mkdir(true);
+	for (const fs::Path &directory : {flat, sharded}) {
+		if (directory.exists()) {
+			directory.unlink(true);
+		}
+	}
+	flat.mkdir();
+
+	logger::info("Cache layout benchmark (" + String(CACHE_ENTRIES) + " entries, " + String(fs::Cache::FANOUT * fs::Cache::FANOUT) + " leaf directories)");
+
+	fs::Cache store(sharded);
+	const std::vector<uint8_t> data(64, 0x55);
+	unsigned long entries = 0;
+	uint32_t random = 1;
+
+	for (auto checkpoint : checkpoints) {
+		uint64_t flatInsert = 0;
+		uint64_t shardedInsert = 0;
+		const unsigned long added = checkpoint - entries;
+		for (; entries < checkpoint; entries++) {
+			uint64_t start = nanos();
+			(flat / key(entries)).write(data);
+			flatInsert += nanos() - start;
+
+			start = nanos();
+			store.insert(key(entries), data);
+			shardedInsert += nanos() - start;
+		}
+
+		// Open random entries, so every directory is searched rather than just the most recent ones.
+		uint64_t flatOpen = 0;
+		uint64_t shardedOpen = 0;
+		unsigned long misses = 0;
+		for (int i = 0; i < CACHE_OPENS; i++) {
+			random = random * 1664525u + 1013904223u;
+			const String name = key(random % entries);
+
+			uint64_t start = nanos();
+			misses += !touch(flat / name);
+			flatOpen += nanos() - start;
+
+			start = nanos();
+			misses += !touch(store.path(name));
+			shardedOpen += nanos() - start;
+		}
+
+		logger::info("  " + String(entries) + " entries: open " + String(flatOpen / 1e3 / CACHE_OPENS, 1) + " us flat, " + String(shardedOpen / 1e3 / CACHE_OPENS, 1) + " us sharded; insert " + String(flatInsert / 1e3 / added, 1) + " us flat, " + String(shardedInsert / 1e3 / added, 1) + " us sharded" + (misses ? ", " + String(misses) + " MISSING" : ""));
+	}
+
+	// Check the bound on directory size.
+	unsigned long largest = 0;
+	for (const fs::Path &top : sharded) {
+		for (const fs::Path &leaf : top) {
+			unsigned long count = 0;
+			for (const fs::Path &file : leaf) {
+				count++;
+			}
+			largest = count > largest ? count : largest;
+		}
+	}
+	logger::info("  Largest directory: " + String(entries) + " files flat, " + String(largest) + " sharded (" + String(entries / (fs::Cache::FANOUT * fs::Cache::FANOUT)) + " on average)");
+
+	flat.unlink(true);
+	sharded.unlink(true);
+}
+
+} // namespace bench
+
+#endif
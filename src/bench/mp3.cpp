@@ -0,0 +1,58 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../audio/mp3.hpp"
+#include "../fs/path.hpp"
+#include "../logger.hpp"
+
+namespace bench {
+
+void mp3() {
+	// There's no MP3 encoder to generate a fixture with, so this needs a real file.
+	fs::Path file("/bench.mp3");
+	if (!file.isFile()) {
+		logger::warn("Skipping MP3 benchmark, put an MP3 file at " + fs::_path(file.str()) + " to run it.");
+		return;
+	}
+
+	audio::FileSource stream(file);
+	audio::mp3::header_t header;
+	if (!audio::mp3::parse(stream, header)) {
+		logger::error("Benchmark file is not a valid MP3.");
+		return;
+	}
+
+	audio::Mp3Decoder decoder(stream, header);
+	std::vector<int16_t> buf(1024 * header.numChannels);
+
+	unsigned long frames = 0;
+	const uint64_t startTime = nanos();
+	while (size_t count = decoder.read(buf.data(), 1024)) {
+		frames += count;
+	}
+	const uint64_t decodeTime = nanos() - startTime;
+
+	// Seeking to the end and back again exercises building the index, then using it.
+	uint64_t seekStart = nanos();
+	decoder.seek(header.totalFrames * 9 / 10);
+	decoder.read(buf.data(), 1);
+	const uint64_t indexedSeekTime = nanos() - seekStart;
+
+	audio::Mp3Decoder fresh(stream, header);
+	seekStart = nanos();
+	fresh.seek(header.totalFrames * 9 / 10);
+	fresh.read(buf.data(), 1);
+	const uint64_t unindexedSeekTime = nanos() - seekStart;
+
+	const double seconds = static_cast<double>(frames) / header.sampleRate;
+	const double realtime = seconds / (decodeTime / 1e9);
+
+	logger::info("MP3 benchmark (" + String(header.sampleRate) + " Hz, " + String((int)header.numChannels) + " channels, " + String(seconds, 1) + " s)");
+	logger::info("  decode: " + String(static_cast<double>(decodeTime) / frames, 1) + " ns/frame, " + String(realtime, 1) + "x real time");
+	logger::info("  seek to 90%: " + String(unindexedSeekTime / 1000.0, 1) + " us unindexed, " + String(indexedSeekTime / 1000.0, 1) + " us indexed");
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,185 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../audio/dac.hpp"
+#include "../audio/player.hpp"
+#include "../audio/sink.hpp"
+#include "../fs/path.hpp"
+#include "../logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+/// The length of each generated fixture.
+#define FIXTURE_SECONDS 5
+
+/// The number of heap allocations made through operator new, so the benchmark can check the hot path doesn't allocate.
+static std::atomic<unsigned long> allocations(0);
+
+void *operator new(size_t size) {
+	allocations++;
+	if (void *ptr = std::malloc(size ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace bench {
+
+/// A combination of WAV parameters to generate a fixture for.
+struct Fixture {
+	unsigned long sampleRate;
+	unsigned int bitsPerSample;
+	unsigned int channels;
+};
+
+static const Fixture fixtures[] = {
+	{22050, 8, 1},
+	{22050, 16, 2},
+	{44100, 16, 1},
+	{44100, 16, 2},
+	{44100, 24, 2},
+	{48000, 16, 2},
+	{48000, 24, 1},
+	{96000, 24, 2},
+};
+
+/// Append a little-endian value to a byte buffer.
+static void put(std::vector<uint8_t> &data, uint32_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		data.push_back((value >> (i * 8)) & 0xff);
+	}
+}
+
+/// Write a WAV file of a sine sweep, with a slightly different tone in each channel.
+static bool generate(const fs::Path &file, const Fixture &fixture) {
+	const unsigned int bytesPerSample = fixture.bitsPerSample / 8;
+	const unsigned int blockAlign = bytesPerSample * fixture.channels;
+	const unsigned long frames = fixture.sampleRate * FIXTURE_SECONDS;
+	const uint32_t dataSize = frames * blockAlign;
+
+	std::vector<uint8_t> data;
+	data.reserve(44 + dataSize);
+	data.insert(data.end(), {'R', 'I', 'F', 'F'});
+	put(data, 36 + dataSize, 4);
+	data.insert(data.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+	put(data, 16, 4);
+	put(data, 1, 2); // PCM
+	put(data, fixture.channels, 2);
+	put(data, fixture.sampleRate, 4);
+	put(data, fixture.sampleRate * blockAlign, 4);
+	put(data, blockAlign, 2);
+	put(data, fixture.bitsPerSample, 2);
+	data.insert(data.end(), {'d', 'a', 't', 'a'});
+	put(data, dataSize, 4);
+
+	double phase[2] = {0, 0};
+	for (unsigned long i = 0; i < frames; i++) {
+		const double sweep = 200.0 + 4000.0 * i / frames;
+		for (unsigned int c = 0; c < fixture.channels; c++) {
+			phase[c] += 2 * M_PI * sweep * (1.0 + 0.01 * c) / fixture.sampleRate;
+			const double value = 0.5 * std::sin(phase[c]);
+
+			if (bytesPerSample == 1) {
+				put(data, static_cast<uint8_t>(std::lround(value * 127) + 128), 1);
+			} else if (bytesPerSample == 2) {
+				put(data, static_cast<uint16_t>(static_cast<int16_t>(std::lround(value * 32767))), 2);
+			} else {
+				put(data, static_cast<uint32_t>(static_cast<int32_t>(std::lround(value * 8388607))), 3);
+			}
+		}
+	}
+
+	return file.write(data);
+}
+
+/// Get a percentile of a sorted list of timings.
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double fraction) {
+	return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+/// Play a file through the whole output path, timing each DAC buffer.
+static void measure(const fs::Path &file, const Fixture &fixture) {
+	audio::Player player(file);
+	if (!player.good()) {
+		logger::error("Failed to open benchmark fixture " + file.str());
+		return;
+	}
+	player.play();
+
+	// Enough room for every buffer, so recording timings doesn't allocate.
+	std::vector<uint64_t> timings;
+	timings.reserve(FIXTURE_SECONDS * AUDIO_OUTPUT_RATE / audio::dac::BUFFER_SIZE + 16);
+	unsigned long allocated = 0;
+
+	const uint64_t startTime = nanos();
+	while (true) {
+		const unsigned long startAllocations = allocations;
+		const uint64_t bufferStart = nanos();
+		if (!player.output()) {
+			break;
+		}
+		timings.push_back(nanos() - bufferStart);
+		allocated += allocations - startAllocations;
+	}
+	const uint64_t elapsed = nanos() - startTime;
+
+	if (timings.empty()) {
+		logger::error("No audio was produced from " + file.str());
+		return;
+	}
+
+	const size_t samples = timings.size() * audio::dac::BUFFER_SIZE;
+	const double bufferMicros = 1e6 * audio::dac::BUFFER_SIZE / AUDIO_OUTPUT_RATE;
+	std::sort(timings.begin(), timings.end());
+
+	logger::info("  " + String(fixture.sampleRate) + " Hz " + String(fixture.bitsPerSample) + "-bit " + (fixture.channels == 2 ? "stereo" : "mono") + ": " +
+	             String(samples / (elapsed / 1e9) / 1e6, 2) + " M samples/s, " +
+	             "p50 " + String(percentile(timings, 0.5) / 1000.0, 1) + " us, " +
+	             "p90 " + String(percentile(timings, 0.9) / 1000.0, 1) + " us, " +
+	             "p99 " + String(percentile(timings, 0.99) / 1000.0, 1) + " us, " +
+	             "max " + String(timings.back() / 1000.0, 1) + " us (" + String(100.0 * timings.back() / 1000.0 / bufferMicros, 1) + "% of a buffer), " +
+	             String(static_cast<double>(allocated) / timings.size(), 2) + " allocs/buffer");
+}
+
+void pipeline() {
+	fs::Path dir("/bench");
+	if (!dir.mkdir(true)) {
+		logger::error("Failed to create benchmark fixture directory.");
+		return;
+	}
+
+	// Take buffers as fast as they come, rather than at the real sample rate.
+	audio::NullSink sink(audio::dac::QUEUE_DEPTH, false);
+	audio::dac::setSink(&sink);
+
+	logger::info("Audio pipeline benchmark (decode, resample, gain and 12-bit conversion per " + String((unsigned long)audio::dac::BUFFER_SIZE) + "-sample buffer)");
+
+	for (const auto &fixture : fixtures) {
+		fs::Path file("/bench/pipeline-" + String(fixture.sampleRate) + "-" + String(fixture.bitsPerSample) + "-" + String(fixture.channels) + ".wav");
+		if (!file.isFile() && !generate(file, fixture)) {
+			logger::error("Failed to generate benchmark fixture " + file.str());
+			continue;
+		}
+
+		measure(file, fixture);
+	}
+
+	audio::dac::setSink(nullptr);
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,81 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../audio/resampler.hpp"
+#include "../logger.hpp"
+#include <cmath>
+#include <vector>
+
+namespace bench {
+
+/// Source rates to test against the output rate.
+static const unsigned long sourceRates[] = {8000, 22050, 32000, 44100, 48000, 96000};
+
+/// Resample `input` in the same block-by-block way as audio::Player.
+static std::vector<int16_t> resample(audio::Resampler &resampler, const std::vector<int16_t> &input, size_t outputs) {
+	std::vector<int16_t> output(outputs);
+	size_t produced = 0;
+	size_t offset = 0;
+
+	while (produced < outputs) {
+		produced += resampler.read(output.data() + produced, std::min<size_t>(audio::dac::BUFFER_SIZE, outputs - produced));
+		if (offset < input.size()) {
+			offset += resampler.write(input.data() + offset, input.size() - offset);
+		} else if (produced < outputs) {
+			break;
+		}
+	}
+
+	output.resize(produced);
+	return output;
+}
+
+void resampler() {
+	const double frequency = 1000.0;
+	const double amplitude = 16384.0;
+	const size_t seconds = 2;
+
+	logger::info("Resampler benchmark (output rate " + String(AUDIO_OUTPUT_RATE) + " Hz, " + String((unsigned long)audio::Resampler::TAPS) + " taps, " + String((unsigned long)audio::Resampler::PHASES) + " phases)");
+
+	for (auto rate : sourceRates) {
+		std::vector<int16_t> input(rate * seconds);
+		for (size_t i = 0; i < input.size(); i++) {
+			input[i] = static_cast<int16_t>(std::lround(amplitude * std::sin(2 * M_PI * frequency * i / rate)));
+		}
+
+		const size_t outputs = static_cast<size_t>(static_cast<uint64_t>(input.size()) * AUDIO_OUTPUT_RATE / rate) - audio::Resampler::TAPS;
+
+		audio::Resampler resampler(rate, 1);
+		const uint64_t startTime = nanos();
+		const uint64_t startCycles = cycles();
+		auto output = resample(resampler, input, outputs);
+		const uint64_t elapsedCycles = cycles() - startCycles;
+		const uint64_t elapsedTime = nanos() - startTime;
+
+		// Compare against the ideal sine at each output time, skipping the filter's warm-up.
+		const size_t warmup = audio::Resampler::TAPS * AUDIO_OUTPUT_RATE / rate + 1;
+		double signal = 0;
+		double noise = 0;
+		int16_t peak = 0;
+		for (size_t i = warmup; i < output.size(); i++) {
+			const double expected = amplitude * std::sin(2 * M_PI * frequency * i / AUDIO_OUTPUT_RATE);
+			const double error = output[i] - expected;
+			signal += expected * expected;
+			noise += error * error;
+			if (std::abs(error) > peak) {
+				peak = static_cast<int16_t>(std::abs(error));
+			}
+		}
+
+		const double snr = noise > 0 ? 10 * std::log10(signal / noise) : INFINITY;
+		const double nsPerSample = static_cast<double>(elapsedTime) / output.size();
+		const double cyclesPerSample = static_cast<double>(elapsedCycles) / output.size();
+
+		logger::info("  " + String(rate) + " Hz: " + String(nsPerSample, 1) + " ns/sample, " + String(cyclesPerSample, 1) + " cycles/sample, SNR " + String(snr, 1) + " dB, max error " + String((int)peak) + (resampler.passthrough() ? " (passthrough)" : ""));
+	}
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,83 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../audio/decoder.hpp"
+#include "../fs.hpp"
+#include "../logger.hpp"
+#include <vector>
+
+/// The number of times each file is decoded, so short files still give a stable timing.
+#define SOURCE_PASSES 5
+
+namespace bench {
+
+/// Decode a whole file a few times from a source opened the current way, returning the time taken per pass.
+static uint64_t decode(const fs::Path &file, unsigned long &frames) {
+	std::vector<int16_t> out(1024 * 2);
+	uint64_t elapsed = 0;
+	frames = 0;
+
+	for (int pass = 0; pass < SOURCE_PASSES; pass++) {
+		const uint64_t start = nanos();
+		audio::Source *source = audio::openFile(file);
+		audio::Decoder *decoder = *source ? audio::Decoder::open(*source) : nullptr;
+		if (!decoder) {
+			delete source;
+			return 0;
+		}
+
+		frames = 0;
+		while (size_t count = decoder->read(out.data(), out.size() / decoder->channels())) {
+			frames += count;
+		}
+		delete decoder;
+		delete source;
+		elapsed += nanos() - start;
+	}
+
+	return elapsed / SOURCE_PASSES;
+}
+
+void sources() {
+#ifdef FS_MMAP
+	logger::info("File source benchmark (whole-file decode through stdio and read-ahead, against a memory mapping)");
+
+	std::vector<fs::Path> files;
+	for (const fs::Path &file : fs::Path("/bench")) {
+		if (file.isFile() && file.ext() == "wav") {
+			files.push_back(file);
+		}
+	}
+	if (fs::Path("/bench.mp3").isFile()) {
+		files.push_back(fs::Path("/bench.mp3"));
+	}
+	if (files.empty()) {
+		logger::warn("Skipping file source benchmark, run the pipeline benchmark first to generate fixtures.");
+		return;
+	}
+
+	for (const fs::Path &file : files) {
+		unsigned long frames;
+		audio::mapFiles(false);
+		const uint64_t stdio = decode(file, frames);
+		audio::mapFiles(true);
+		const uint64_t mapped = decode(file, frames);
+		audio::mapFiles(false);
+
+		if (!stdio || !mapped) {
+			logger::error("Failed to decode " + file.str());
+			continue;
+		}
+
+		const double megabytes = file.size() / (1024.0 * 1024.0);
+		logger::info("  " + file.name() + ": " + String(megabytes / (stdio / 1e9), 1) + " MB/s stdio, " + String(megabytes / (mapped / 1e9), 1) + " MB/s mapped (" + String(static_cast<double>(stdio) / mapped, 2) + "x), " + String(frames) + " frames");
+	}
+#else
+	logger::warn("Skipping file source benchmark, memory mapping is not available here.");
+#endif
+}
+
+} // namespace bench
+
+#endif
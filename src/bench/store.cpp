@@ -0,0 +1,94 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../fs/store.hpp"
+#include "../logger.hpp"
+
+/// The number of keys, e.g. play counts for a library of songs.
+#define STORE_KEYS 500
+
+/// The number of updates to time.
+#define STORE_UPDATES 2000
+
+namespace bench {
+
+/// Get the key of the nth entry.
+static String storeKey(unsigned long n) {
+	return "plays/song-" + String(n);
+}
+
+void store() {
+	const fs::Path json("/bench/plays.json");
+	const fs::Path log("/bench/plays.db");
+	fs::Path("/bench").mkdir(true);
+	for (const fs::Path &file : {json, log}) {
+		if (file.exists()) {
+			file.unlink();
+		}
+	}
+
+	logger::info("Metadata store benchmark (" + String(STORE_KEYS) + " keys, " + String(STORE_UPDATES) + " updates)");
+
+	std::vector<unsigned long> plays(STORE_KEYS, 0);
+	uint64_t jsonUpdate = 0;
+	uint64_t storeUpdate = 0;
+	uint64_t jsonBytes = 0;
+	uint32_t random = 1;
+	{
+		fs::Store store(log);
+		for (unsigned long i = 0; i < STORE_UPDATES; i++) {
+			random = random * 1664525u + 1013904223u;
+			const unsigned long n = random % STORE_KEYS;
+			plays[n]++;
+
+			// Rewriting a whole JSON object for every change, as the config files are.
+			uint64_t start = nanos();
+			String text = "{";
+			for (unsigned long k = 0; k < STORE_KEYS; k++) {
+				text += k ? ",\"" : "\"";
+				text += storeKey(k) + "\":" + String(plays[k]);
+			}
+			text += "}";
+			json.write(text);
+			jsonUpdate += nanos() - start;
+			jsonBytes += text.length();
+
+			start = nanos();
+			store.put(storeKey(n), String(plays[n]));
+			storeUpdate += nanos() - start;
+		}
+	}
+	json.invalidate();
+	log.invalidate();
+
+	logger::info("  Update: " + String(jsonUpdate / 1e3 / STORE_UPDATES, 1) + " us rewriting JSON (" + String(static_cast<unsigned long>(jsonBytes / STORE_UPDATES)) + " bytes each), " + String(storeUpdate / 1e3 / STORE_UPDATES, 1) + " us appending to the store");
+
+	// Opening the store replays its log, and each lookup then reads one record.
+	uint64_t start = nanos();
+	const size_t length = json.read().length();
+	const uint64_t jsonLoad = nanos() - start;
+
+	start = nanos();
+	fs::Store store(log);
+	const uint64_t storeLoad = nanos() - start;
+
+	start = nanos();
+	String value;
+	unsigned long wrong = 0;
+	for (unsigned long k = 0; k < STORE_KEYS; k++) {
+		if (plays[k] && (!store.get(storeKey(k), value) || value != String(plays[k]))) {
+			wrong++;
+		}
+	}
+	const uint64_t storeGet = nanos() - start;
+
+	logger::info("  Load: " + String(jsonLoad / 1e3, 1) + " us reading JSON (" + String(static_cast<unsigned long>(length)) + " bytes), " + String(storeLoad / 1e3, 1) + " us opening the store (" + String(log.size()) + " bytes, " + String(store.size()) + " keys), then " + String(storeGet / 1e3 / STORE_KEYS, 1) + " us per lookup" + (wrong ? ", " + String(wrong) + " WRONG" : ""));
+
+	json.unlink();
+	log.unlink();
+}
+
+} // namespace bench
+
+#endif
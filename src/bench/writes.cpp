@@ -0,0 +1,93 @@
+#include "../bench.hpp"
+
+#if defined(EMULATE) && defined(BENCHMARK)
+
+#include "../fs.hpp"
+#include "../logger.hpp"
+#include <vector>
+
+/// The amount of data written by each pattern.
+#define WRITE_TOTAL_BYTES (4 * 1024 * 1024)
+
+namespace bench {
+
+/// Sizes of the pieces data arrives in: small packets, a TCP segment, and a full page.
+static const size_t chunkSizes[] = {512, 1460, 4096};
+
+/// Log the throughput of one write pattern, and the longest the caller was held up by a single chunk.
+static void report(const char *name, size_t chunkSize, uint64_t elapsed, uint64_t worst, unsigned long opens, unsigned long writes) {
+	const double seconds = elapsed / 1e9;
+	logger::info("  " + String(name) + ", " + String((unsigned long)chunkSize) + " B chunks: " + String(WRITE_TOTAL_BYTES / seconds / (1024 * 1024), 1) + " MB/s, worst chunk " + String(worst / 1e3, 1) + " us, " + String(opens) + " opens, " + String(writes) + " fwrite calls");
+}
+
+/// Time one chunk's write, keeping track of the slowest.
+template <typename Write>
+static void timed(uint64_t &worst, Write write) {
+	const uint64_t start = nanos();
+	write();
+	const uint64_t elapsed = nanos() - start;
+	if (elapsed > worst) {
+		worst = elapsed;
+	}
+}
+
+void writes() {
+	const fs::Path file("/bench/writes.bin");
+	fs::Path("/bench").mkdir(true);
+
+	fs::WriteBehind worker(fs::FileWriter::DEFAULT_BUFFER);
+	logger::info("Write pattern benchmark (" + String(WRITE_TOTAL_BYTES / 1024) + " KB per pattern, cluster size " + String((unsigned long)fs::clusterSize()) + " B)");
+
+	for (auto chunkSize : chunkSizes) {
+		std::vector<uint8_t> chunk(chunkSize);
+		for (size_t i = 0; i < chunkSize; i++) {
+			chunk[i] = static_cast<uint8_t>(i * 31);
+		}
+		const unsigned long chunks = WRITE_TOTAL_BYTES / chunkSize;
+
+		// What DownloadQueue used to do: open, append and close the file for every chunk.
+		file.write(std::vector<uint8_t>());
+		uint64_t worst = 0;
+		uint64_t start = nanos();
+		for (unsigned long i = 0; i < chunks; i++) {
+			timed(worst, [&] { file.write(chunk, true); });
+		}
+		report("open/append/close", chunkSize, nanos() - start, worst, chunks, chunks);
+
+		// Keep the file open, leaving buffering to stdio.
+		worst = 0;
+		start = nanos();
+		FILE *handle = fopen(fs::_path(file.str()).c_str(), "wb");
+		for (unsigned long i = 0; i < chunks; i++) {
+			timed(worst, [&] { fwrite(chunk.data(), 1, chunkSize, handle); });
+		}
+		fclose(handle);
+		report("stdio, kept open", chunkSize, nanos() - start, worst, 1, chunks);
+
+		// A FileWriter, coalescing into cluster-aligned writes.
+		worst = 0;
+		start = nanos();
+		fs::FileWriter writer = file.writer();
+		for (unsigned long i = 0; i < chunks; i++) {
+			timed(worst, [&] { writer.write(chunk); });
+		}
+		writer.close();
+		report("FileWriter", chunkSize, nanos() - start, worst, 1, writer.transfers());
+
+		// The same, with full buffers written by a background worker, as DownloadQueue does.
+		worst = 0;
+		start = nanos();
+		writer = file.writer(false, &worker);
+		for (unsigned long i = 0; i < chunks; i++) {
+			timed(worst, [&] { writer.write(chunk); });
+		}
+		writer.close();
+		report("FileWriter, write-behind", chunkSize, nanos() - start, worst, 1, writer.transfers());
+	}
+
+	file.unlink();
+}
+
+} // namespace bench
+
+#endif
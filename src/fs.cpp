@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #else
 #include <Arduino_USBHostMbed5.h>
+#include <mbed.h>
 #endif
 
 namespace fs {
@@ -17,7 +18,73 @@ static USBHostMSD device;
 static mbed::FATFileSystem filesystem("usb");
 #endif
 
-static bool initialized = false;
+// How long to wait between attempts to remount a drive that dropped out, in milliseconds.
+#define RECONNECT_INTERVAL_MS 500
+
+static State current = DISCONNECTED;
+static unsigned long mounts = 0;
+static unsigned long lastAttempt = 0;
+
+#ifndef EMULATE
+// The stack size of the thread that brings a drive back. Enumeration goes through the USB host stack, which needs a few KB.
+#define RECONNECT_STACK_SIZE 4096
+
+// USBHostMSD::connect() doesn't return until enumeration has finished, which can take far longer than the DAC queue lasts,
+// so poll() leaves it to this thread. It runs at the same priority as the main loop, like the write-behind worker.
+static rtos::Thread reconnector(osPriorityNormal, RECONNECT_STACK_SIZE, nullptr, "usbReconnect");
+static rtos::EventFlags reconnectRequests;
+static bool reconnectorStarted = false;
+
+/// Try to enumerate the drive again each time poll() asks for it.
+static void reconnectLoop() {
+	while (true) {
+		reconnectRequests.wait_any(1);
+		if (!device.connected()) {
+			device.connect();
+		}
+	}
+}
+
+/// Ask the reconnection thread for another attempt, starting it the first time. This returns straight away.
+static void requestReconnect() {
+	if (!reconnectorStarted) {
+		reconnector.start(reconnectLoop);
+		reconnectorStarted = true;
+	}
+	reconnectRequests.set(1);
+}
+#endif
+
+/// Check if the drive is still there, without touching the filesystem.
+static bool present() {
+#ifdef EMULATE
+	// The drive is a directory, so "unplugging" it is removing or renaming the directory.
+	struct stat st;
+	return stat("./usb", &st) == 0 && S_ISDIR(st.st_mode);
+#else
+	return device.connected();
+#endif
+}
+
+/// Mount the filesystem on a connected drive.
+static bool mount() {
+#ifndef EMULATE
+	int error = filesystem.mount(&device);
+	if (error) {
+		logger::error("Failed to mount filesystem (Error code " + String(error) + ")");
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat("./usb", &st) != 0) {
+		mkdir("./usb", 0755);
+	}
+#endif
+
+	current = MOUNTED;
+	mounts++;
+	return true;
+}
 
 bool connect(int maxRetries) {
 #ifndef EMULATE
@@ -28,7 +95,7 @@ bool connect(int maxRetries) {
 	if (!device.connected()) {
 		pins::yellow();
 
-		initialized = false; // Reset initialization state
+		current = DISCONNECTED; // Reset initialization state
 		filesystem.unmount();
 
 		logger::info("Connecting USB device", false);
@@ -51,35 +118,27 @@ bool connect(int maxRetries) {
 		}
 	}
 
-	if (initialized) {
+	if (current == MOUNTED) {
 		return true; // Already initialized
 	}
 
-	// Mount the filesystem
-	int error = filesystem.mount(&device);
-	if (error) {
-		logger::error("Failed to mount filesystem (Error code " + String(error) + ")");
+	if (!mount()) {
 		pins::off();
 		return false;
 	}
 
 	pins::off();
+	return true;
 #else
-	struct stat st;
-	if (stat("./usb", &st) != 0) {
-		mkdir("./usb", 0755);
-	}
+	return current == MOUNTED || mount();
 #endif
-
-	initialized = true;
-	return true;
 }
 
 bool connected() {
 #ifdef EMULATE
-	return initialized;
+	return current == MOUNTED;
 #else
-	return initialized && device.connected();
+	return current == MOUNTED && device.connected();
 #endif
 }
 
@@ -87,10 +146,59 @@ void disconnect() {
 #ifndef EMULATE
 	filesystem.unmount();
 #endif
-	initialized = false;
+	current = DISCONNECTED;
 	logger::info("USB device disconnected.");
 }
 
+void poll() {
+	if (current == MOUNTED) {
+		if (present()) {
+			return;
+		}
+
+		// The drive glitched or was pulled. Drop the mount, since nothing opened on it can be used again,
+		// and keep trying to bring it back rather than failing everything that was using it.
+#ifndef EMULATE
+		filesystem.unmount();
+#endif
+		current = UNAVAILABLE;
+		lastAttempt = millis();
+		pins::yellow();
+		logger::warn("USB device dropped out, waiting for it to come back.");
+		return;
+	}
+
+	if (current != UNAVAILABLE || millis() - lastAttempt < RECONNECT_INTERVAL_MS) {
+		return;
+	}
+
+	lastAttempt = millis();
+#ifndef EMULATE
+	if (!device.connected()) {
+		requestReconnect(); // Mounted by a later call, once the thread has enumerated the drive.
+		return;
+	}
+#endif
+	if (!present() || !mount()) {
+		return;
+	}
+
+	pins::off();
+	logger::info("USB device reconnected.");
+}
+
+State state() {
+	return current;
+}
+
+bool unavailable() {
+	return current == UNAVAILABLE;
+}
+
+unsigned long generation() {
+	return mounts;
+}
+
 size_t size() {
 	if (!connected()) {
 		return 0;
@@ -144,6 +252,17 @@ size_t free() {
 #endif
 }
 
+size_t clusterSize() {
+#ifndef EMULATE
+	struct statvfs fsInfo;
+	if (connected() && statvfs("/usb", &fsInfo) == 0 && fsInfo.f_bsize) {
+		return fsInfo.f_bsize;
+	}
+#endif
+	// The default cluster size for FAT32 drives up to 8GB.
+	return 4096;
+}
+
 String _path(const String &path) {
 #ifndef EMULATE
 	return "/usb" + path;
@@ -5,6 +5,18 @@
 
 namespace fs {
 
+/**
+ * @brief The state of the USB drive.
+ */
+enum State {
+	/// Not connected, either because connect() hasn't been called or because of disconnect().
+	DISCONNECTED,
+	/// Connected and mounted.
+	MOUNTED,
+	/// Was mounted, but the drive dropped off the bus. poll() keeps trying to remount it.
+	UNAVAILABLE,
+};
+
 /**
  * @brief Waits for the USB device to be connected and mounts the filesystem.
  * @param maxRetries The maximum number of retries to wait for the USB device to be connected.
@@ -24,6 +36,36 @@ bool connected();
  */
 void disconnect();
 
+/**
+ * @brief Watches for the USB drive dropping off the bus and remounts it when it comes back.
+ * Checking the drive is quick. Enumerating it again, which can take longer than the audio output is queued for,
+ * is done on a background thread, so a call never waits for it; the most a call does itself is mount the filesystem
+ * once the drive is back, which reads a few sectors. Attempts are spaced out.
+ * While the drive is away, open FileStreams report that they are temporarily unavailable rather than failing,
+ * and pick up where they left off once it has been remounted.
+ * @note This should be called regularly from the main loop once connect() has succeeded.
+ */
+void poll();
+
+/**
+ * @brief Returns the state of the USB drive.
+ * @return The current state.
+ */
+State state();
+
+/**
+ * @brief Checks if the USB drive is only temporarily away, i.e. it dropped out and poll() is trying to remount it.
+ * @return True if the drive is unavailable but expected back, false otherwise.
+ */
+bool unavailable();
+
+/**
+ * @brief Returns a counter that goes up every time the filesystem is mounted.
+ * Files and directories opened before the current mount have to be opened again before they can be used.
+ * @return The mount generation.
+ */
+unsigned long generation();
+
 /**
  * @brief Returns the total space on the USB device in bytes.
  * @return The amount of total space in bytes.
@@ -42,6 +84,13 @@ size_t used();
  */
 size_t free();
 
+/**
+ * @brief Returns the size of one cluster (allocation unit) on the USB device in bytes.
+ * Reads and writes that are a whole number of clusters, starting on a cluster boundary, need the fewest USB transfers.
+ * @return The cluster size in bytes.
+ */
+size_t clusterSize();
+
 /**
  * @brief Returns a formatted path for the given file path.
  * @param path The original file path.
@@ -52,4 +101,6 @@ String _path(const String &path);
 } // namespace fs
 
 #include "fs/fileStream.hpp"
+#include "fs/fileWriter.hpp"
+#include "fs/mappedStream.hpp"
 #include "fs/path.hpp"
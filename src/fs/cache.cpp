@@ -0,0 +1,136 @@
+#include "cache.hpp"
+#include "../util/hash.hpp"
+#include <stdio.h>
+#include <string.h>
+
+namespace fs {
+
+constexpr unsigned int Cache::FANOUT;
+
+// The number of base-36 digits in a file name, split 8.3. These hold the 56 bits of the hash below the directories.
+#define CACHE_NAME_DIGITS 11
+
+static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/// Hash a key.
+static uint64_t digest(const String &key) {
+	// The top bits pick the directories, so they're mixed to make the directories fill evenly.
+	return mix64(fnv1a64(key.c_str(), key.length()));
+}
+
+/// Get the first level directory for a hash, from its top 4 bits.
+static unsigned int firstLevel(uint64_t hash) {
+	return hash >> 60;
+}
+
+/// Get the second level directory for a hash, from the 4 bits after that.
+static unsigned int secondLevel(uint64_t hash) {
+	return (hash >> 56) & 0xF;
+}
+
+Cache::Cache(const Path &root) : root(root), mount(generation()) {
+	memset(created, 0, sizeof(created));
+}
+
+Path Cache::path(const String &key) const {
+	const uint64_t hash = digest(key);
+
+	// The rest of the hash names the file. 11 base-36 digits are just enough for 56 bits.
+	char name[CACHE_NAME_DIGITS + 1];
+	uint64_t rest = hash & 0x00FFFFFFFFFFFFFFull;
+	for (int i = CACHE_NAME_DIGITS - 1; i >= 0; i--) {
+		name[i] = digits[rest % 36];
+		rest /= 36;
+	}
+
+	char relative[17];
+	snprintf(relative, sizeof(relative), "%c/%c/%.8s.%.3s", digits[firstLevel(hash)], digits[secondLevel(hash)], name, name + 8);
+	return root / relative;
+}
+
+bool Cache::prepare(const String &key) {
+	const uint64_t hash = digest(key);
+	const unsigned int first = firstLevel(hash);
+	const unsigned int second = secondLevel(hash);
+
+	if (mount != generation()) {
+		memset(created, 0, sizeof(created));
+		root.invalidate();
+		mount = generation();
+	}
+
+	if (created[first] & (1u << second)) {
+		return true;
+	}
+
+	const Path top = root / String(digits[first]);
+	const Path leaf = top / String(digits[second]);
+	if ((!created[first] && (!root.mkdir(true) || !top.mkdir(true))) || !leaf.mkdir(true)) {
+		logger::error("Failed to create cache directory: " + leaf.str());
+		return false;
+	}
+
+	created[first] |= 1u << second;
+	return true;
+}
+
+bool Cache::lookup(const String &key, Path &file) const {
+	const Path cached = path(key);
+	if (!cached.isFile()) {
+		return false;
+	}
+	file = cached;
+	return true;
+}
+
+bool Cache::contains(const String &key) const {
+	return path(key).isFile();
+}
+
+void Cache::forget(const String &key) {
+	// The top level directory, or the whole cache, may have gone too, so check them again along with every leaf under it.
+	created[firstLevel(digest(key))] = 0;
+	root.invalidate();
+}
+
+bool Cache::reserve(const String &key, Path &file) {
+	if (!prepare(key)) {
+		return false;
+	}
+	file = path(key);
+	return true;
+}
+
+bool Cache::insert(const String &key, const std::vector<uint8_t> &data) {
+	Path file("");
+	if (!reserve(key, file)) {
+		return false;
+	}
+
+	if (!file.write(data)) {
+		forget(key);
+		return false;
+	}
+	return true;
+}
+
+bool Cache::insert(const String &key, const Path &file) {
+	Path cached("");
+	if (!reserve(key, cached)) {
+		return false;
+	}
+
+	if (!file.rename(cached, true)) {
+		logger::error("Failed to move file into cache: " + file.str());
+		forget(key);
+		return false;
+	}
+	return true;
+}
+
+bool Cache::remove(const String &key) {
+	const Path cached = path(key);
+	return cached.isFile() && cached.unlink();
+}
+
+} // namespace fs
@@ -0,0 +1,119 @@
+/// @file cache.hpp
+#pragma once
+
+#include "../fs.hpp"
+#include <vector>
+
+namespace fs {
+
+/**
+ * @brief A directory of cached files, looked up by key (such as a song or cover art ID).
+ *
+ * FAT directories are searched linearly, so a single directory holding thousands of files makes every
+ * open, stat and listing slower as the cache grows. Instead, each key is hashed (64 bits), and its file is stored
+ * two directory levels down, chosen by the top two hex digits of the hash:
+ *
+ *     <root>/A/7/0K3F9C21.B7Q
+ *
+ * With FANOUT directories on each level, the files are spread over FANOUT * FANOUT leaf directories,
+ * so 10,000 files come to about 40 per directory. The rest of the hash names the file, in 11 upper case base-36 digits
+ * split 8.3, which FAT stores as a single short directory entry rather than a chain of long file name entries,
+ * so a leaf directory of up to a thousand files still fits in one 32 KB cluster.
+ *
+ * Keys are not stored, but the path holds the whole hash, so a file found at a key's path was stored under a key
+ * with the same 64-bit hash. For 10,000 keys, the chance of any two of them colliding is under one in a hundred billion.
+ *
+ * Directories are created the first time a file is stored in them, and are left in place when it is removed.
+ * If the drive is remounted, or storing a file fails, they are checked again in case they have gone.
+ */
+class Cache {
+public:
+	/// The number of subdirectories on each level, one per hex digit.
+	static constexpr unsigned int FANOUT = 16;
+
+private:
+	Path root;
+	/// The leaf directories known to exist, one bit per second-level directory.
+	uint16_t created[FANOUT];
+	/// The mount the directories were seen on. A different drive, or the same one remounted, may not have them.
+	unsigned long mount;
+
+	/**
+	 * @brief Make sure both levels of directories exist for a key.
+	 * @param key The key to store.
+	 * @return True if the directories exist, false if they could not be created.
+	 */
+	bool prepare(const String &key);
+
+	/**
+	 * @brief Stop assuming a key's directories exist, e.g. after writing into them failed.
+	 * They are checked, and created again if needed, the next time a file is stored in them.
+	 * @param key The key that failed to store.
+	 */
+	void forget(const String &key);
+
+public:
+	/**
+	 * @brief Constructor for the Cache class.
+	 * @param root The directory to store the cache in. It is created when the first file is stored.
+	 */
+	Cache(const Path &root);
+
+	/**
+	 * @brief Get the path a key's file is stored at, whether or not it is in the cache.
+	 * This does not touch the filesystem.
+	 * @param key The key to look up.
+	 * @return The path of the file for the key.
+	 */
+	Path path(const String &key) const;
+
+	/**
+	 * @brief Look up a key.
+	 * @param key The key to look up.
+	 * @param file Set to the path of the cached file, if there is one.
+	 * @return True if the key is in the cache, false otherwise.
+	 */
+	bool lookup(const String &key, Path &file) const;
+
+	/**
+	 * @brief Check if a key is in the cache.
+	 * @param key The key to look up.
+	 * @return True if the key is in the cache, false otherwise.
+	 */
+	bool contains(const String &key) const;
+
+	/**
+	 * @brief Store data in the cache, replacing anything already stored for the key.
+	 * @param key The key to store the data under.
+	 * @param data The contents of the file.
+	 * @return True if the data was stored, false otherwise.
+	 */
+	bool insert(const String &key, const std::vector<uint8_t> &data);
+
+	/**
+	 * @brief Move an existing file into the cache, replacing anything already stored for the key.
+	 * This is a rename, so no data is copied. The file must be on the same drive.
+	 * @param key The key to store the file under.
+	 * @param file The file to move, such as a finished download.
+	 * @return True if the file was moved, false otherwise.
+	 */
+	bool insert(const String &key, const Path &file);
+
+	/**
+	 * @brief Get the path to write a key's file to, creating its directories if needed.
+	 * This is for writing the file in pieces, e.g. with Path::writer() or a DownloadQueue.
+	 * @param key The key to store.
+	 * @param file Set to the path to write the file to.
+	 * @return True if the directories exist, false if they could not be created.
+	 */
+	bool reserve(const String &key, Path &file);
+
+	/**
+	 * @brief Remove a key's file from the cache.
+	 * @param key The key to remove.
+	 * @return True if the file was removed, false if it was not in the cache or could not be removed.
+	 */
+	bool remove(const String &key);
+};
+
+} // namespace fs
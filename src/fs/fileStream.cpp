@@ -1,23 +1,258 @@
 #include "fileStream.hpp"
+#include "../fs.hpp"
 #include "../logger.hpp"
+#include <stdint.h>
+#include <string.h>
 #include <vector>
 
 namespace fs {
 
-FileStream::FileStream(FILE *file) : file(file) {}
+constexpr size_t FileStream::DEFAULT_READ_AHEAD;
+
+FileStream::FileStream(FILE *file, const String &path) : file(file), path(path), mount(generation()), blocks{{nullptr, 0, 0}, {nullptr, 0, 0}}, blockSize(0), alignment(1), doubleBuffered(false), active(0), position(0), length(0), limit(SIZE_MAX) {
+	if (file) {
+		position = ftell(file);
+		refreshSize();
+	}
+}
 
 FileStream::~FileStream() {
+	release();
+}
+
+FileStream::FileStream(FileStream &&other) : file(other.file), path(other.path), mount(other.mount), blocks{other.blocks[0], other.blocks[1]}, blockSize(other.blockSize), alignment(other.alignment), doubleBuffered(other.doubleBuffered), active(other.active), position(other.position), length(other.length), limit(other.limit) {
+	other.file = nullptr;
+	other.blocks[0] = {nullptr, 0, 0};
+	other.blocks[1] = {nullptr, 0, 0};
+	other.blockSize = 0;
+}
+
+FileStream &FileStream::operator=(FileStream &&other) {
+	if (this == &other) {
+		return *this;
+	}
+
+	release();
+	file = other.file;
+	path = other.path;
+	mount = other.mount;
+	blocks[0] = other.blocks[0];
+	blocks[1] = other.blocks[1];
+	blockSize = other.blockSize;
+	alignment = other.alignment;
+	doubleBuffered = other.doubleBuffered;
+	active = other.active;
+	position = other.position;
+	length = other.length;
+	limit = other.limit;
+
+	other.file = nullptr;
+	other.blocks[0] = {nullptr, 0, 0};
+	other.blocks[1] = {nullptr, 0, 0};
+	other.blockSize = 0;
+	return *this;
+}
+
+void FileStream::release() {
 	if (file) {
 		fclose(file);
+		file = nullptr;
+	}
+	path = String();
+	delete[] blocks[0].data;
+	delete[] blocks[1].data;
+	blocks[0] = {nullptr, 0, 0};
+	blocks[1] = {nullptr, 0, 0};
+	blockSize = 0;
+}
+
+bool FileStream::setReadAhead(size_t bytes, bool doubleBuffer) {
+	if (!file) {
+		logger::error("FileStream is not initialized.");
+		return false;
+	}
+
+	delete[] blocks[0].data;
+	delete[] blocks[1].data;
+	blocks[0] = {nullptr, 0, 0};
+	blocks[1] = {nullptr, 0, 0};
+	blockSize = 0;
+	doubleBuffered = false;
+	active = 0;
+
+	if (!bytes) {
+		// Put the file back where the reader is, since it was only seeked for refills.
+		return fseek(file, position, SEEK_SET) == 0;
+	}
+
+	alignment = clusterSize();
+	if (!alignment) {
+		alignment = 1;
+	}
+
+	blockSize = (bytes + alignment - 1) / alignment * alignment;
+	doubleBuffered = doubleBuffer;
+	blocks[0].data = new uint8_t[blockSize];
+	if (doubleBuffered) {
+		blocks[1].data = new uint8_t[blockSize];
+	}
+	return true;
+}
+
+bool FileStream::reopen() {
+	if (mount == generation() && connected()) {
+		return true;
+	}
+	if (!connected() || path.length() == 0) {
+		return false; // Wait for the drive to come back, or give up if there's no way to find the file again.
+	}
+
+	// The drive has been remounted since the file was opened, so the old handle is useless.
+	// Open the file again, and put it back where the reader was. Buffered blocks are still valid, so they're kept.
+	fclose(file);
+	file = fopen(_path(path).c_str(), "rb");
+	if (!file) {
+		logger::error("Failed to reopen file after reconnecting: " + path);
+		path = String();
+		return false;
+	}
+
+	mount = generation();
+	return fseek(file, position, SEEK_SET) == 0;
+}
+
+bool FileStream::fill(Block &block, size_t offset) {
+	// Seek even if the file is already there, since the last read may have hit EOF before the file grew.
+	block.offset = offset;
+	block.length = 0;
+	if (!reopen()) {
+		return false;
+	}
+	if (fseek(file, offset, SEEK_SET) != 0) {
+		if (connected()) {
+			logger::error("Failed to seek in file.");
+		}
+		return false;
+	}
+
+	const size_t wanted = offset >= limit ? 0 : limit - offset < blockSize ? limit - offset : blockSize;
+	block.length = fread(block.data, 1, wanted, file);
+	if (block.length == 0 && ferror(file)) {
+		// A read that fails because the drive dropped out is retried once it's back, so don't report it.
+		if (connected()) {
+			logger::error("Error reading from file.");
+		}
+		return false;
+	}
+	return block.length > 0;
+}
+
+size_t FileStream::readBytes(void *buffer, size_t bytes) {
+	uint8_t *out = static_cast<uint8_t *>(buffer);
+	size_t total = 0;
+
+	if (!blockSize) {
+		// Unbuffered, so read straight from the file.
+		if (!reopen()) {
+			return 0;
+		}
+		total = fread(out, 1, bytes, file);
+		if (total == 0 && ferror(file) && connected()) {
+			logger::error("Error reading from file.");
+		}
+		position += total;
+	} else {
+		while (total < bytes) {
+			if (!blocks[active].contains(position)) {
+				if (doubleBuffered && blocks[active ^ 1].contains(position)) {
+					// Moved on to the prefetched block, leaving the old one free for the next prefetch.
+					active ^= 1;
+				} else if (bytes - total >= blockSize) {
+					// Large reads go straight to the caller rather than being copied through the buffer.
+					if (!reopen()) {
+						break;
+					}
+					if (fseek(file, position, SEEK_SET) != 0) {
+						if (connected()) {
+							logger::error("Failed to seek in file.");
+						}
+						break;
+					}
+
+					const size_t count = fread(out + total, 1, bytes - total, file);
+					if (count == 0 && ferror(file) && connected()) {
+						logger::error("Error reading from file.");
+					}
+					position += count;
+					total += count;
+					break;
+				} else {
+					// Refill whichever buffer isn't being read, starting from the cluster boundary.
+					if (doubleBuffered) {
+						active ^= 1;
+					}
+					if (!fill(blocks[active], position - position % alignment) || !blocks[active].contains(position)) {
+						break;
+					}
+				}
+			}
+
+			const Block &block = blocks[active];
+			const size_t offset = position - block.offset;
+			size_t count = block.length - offset;
+			if (count > bytes - total) {
+				count = bytes - total;
+			}
+
+			memcpy(out + total, block.data + offset, count);
+			position += count;
+			total += count;
+		}
+	}
+
+	// The file may have grown since it was opened.
+	if (position > length) {
+		length = position;
 	}
+	return total;
+}
+
+void FileStream::setReadLimit(size_t bytes) {
+	limit = bytes;
+}
+
+bool FileStream::prefetch() {
+	if (!doubleBuffered || !file) {
+		return false;
+	}
+
+	// A short block means the end of the file was reached, so there's nothing after it yet.
+	const Block &current = blocks[active];
+	if (current.length < blockSize) {
+		return false;
+	}
+
+	const size_t next = current.offset + current.length;
+	Block &spare = blocks[active ^ 1];
+	if (spare.contains(next)) {
+		return false;
+	}
+
+	return fill(spare, next);
 }
 
 bool FileStream::good() const {
-	return file != nullptr && !ferror(file);
+	// A stream waiting for the drive to come back isn't broken, even if its last read failed.
+	return file != nullptr && (unavailable() || !ferror(file));
 }
 
 bool FileStream::bad() const {
-	return file == nullptr || ferror(file);
+	return !good();
+}
+
+bool FileStream::unavailable() const {
+	// The drive can vanish before poll() notices, so anything short of a deliberate disconnect counts.
+	return file != nullptr && path.length() > 0 && !connected() && state() != DISCONNECTED;
 }
 
 bool FileStream::seek(size_t position, int flag) {
@@ -26,15 +261,32 @@ bool FileStream::seek(size_t position, int flag) {
 		return false;
 	}
 
-	if (fseek(file, position, flag) != 0) {
+	const long base = flag == SEEK_CUR ? this->position : flag == SEEK_END ? length : 0;
+	const long target = base + static_cast<long>(position);
+	if (target < 0) {
 		logger::error("Failed to seek in file.");
 		return false;
 	}
+
+	// When buffered, the file itself is only seeked when a buffer needs refilling.
+	// The same goes for a stream waiting for the drive, which is seeked to the position once it's reopened.
+	if (!blockSize && reopen() && fseek(file, target, SEEK_SET) != 0) {
+		logger::error("Failed to seek in file.");
+		return false;
+	}
+
+	this->position = target;
 	return true;
 }
 
+void FileStream::retarget(const String &path) {
+	if (file) {
+		this->path = path;
+	}
+}
+
 size_t FileStream::tell() const {
-	return ftell(file);
+	return position;
 }
 
 size_t FileStream::size() const {
@@ -42,12 +294,23 @@ size_t FileStream::size() const {
 		logger::error("FileStream is not initialized.");
 		return 0;
 	}
+	return length;
+}
+
+size_t FileStream::refreshSize() {
+	if (!file) {
+		logger::error("FileStream is not initialized.");
+		return 0;
+	}
 
-	auto currentPos = ftell(file);
-	fseek(file, 0, SEEK_END);
-	auto fileSize = ftell(file);
-	fseek(file, currentPos, SEEK_SET);
-	return fileSize;
+	if (!reopen()) {
+		return length;
+	}
+	if (fseek(file, 0, SEEK_END) == 0) {
+		length = ftell(file);
+	}
+	fseek(file, position, SEEK_SET);
+	return length;
 }
 
 } // namespace fs
\ No newline at end of file
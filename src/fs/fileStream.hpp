@@ -15,16 +15,61 @@ namespace fs {
 /**
  * @brief A class to represent a file stream.
  * This class provides methods to read from a file in chunks and check the status of the stream.
+ *
+ * Optionally, the stream can read ahead into its own buffer (see setReadAhead()), so that small sequential reads
+ * are served from RAM and the USB drive only sees large reads aligned to the filesystem's clusters.
+ * With double-buffering, the next block can be fetched ahead of time with prefetch(), e.g. from the main loop,
+ * so reads on the playback path rarely have to touch the drive at all.
+ *
+ * A FileStream owns its file, so it can be moved but not copied. The size and position are tracked
+ * by the stream itself, so tell() and size() never have to ask the filesystem.
+ *
+ * A stream opened from a path survives the USB drive dropping out. While it is away, reads return nothing
+ * and unavailable() is true. Once fs::poll() has remounted it, the file is opened again and reading carries on
+ * from the same position, keeping any blocks already buffered.
  */
 class FileStream {
+public:
+	/// The read-ahead buffer size used for audio playback, in bytes.
+	static constexpr size_t DEFAULT_READ_AHEAD = 32768;
+
+private:
+	/// A block of the file held in memory.
+	struct Block {
+		uint8_t *data;
+		size_t offset;
+		size_t length;
+
+		inline bool contains(size_t position) const {
+			return position >= offset && position < offset + length;
+		}
+	};
+
 	FILE *file;
+	String path;
+	unsigned long mount;
+	Block blocks[2];
+	size_t blockSize;
+	size_t alignment;
+	bool doubleBuffered;
+	unsigned int active;
+	size_t position;
+	size_t length;
+	size_t limit;
+
+	size_t readBytes(void *buffer, size_t bytes);
+	bool fill(Block &block, size_t offset);
+	bool reopen();
+	void release();
 
 public:
 	/**
 	 * @brief Constructor for the FileStream class.
 	 * @param file A pointer to the file to be used for the stream. If nullptr, it will not be initialized.
+	 * @param path The path the file was opened from, so it can be opened again after the drive is remounted.
+	 * If empty, the stream ends if the drive drops out.
 	 */
-	FileStream(FILE *file = nullptr);
+	FileStream(FILE *file = nullptr, const String &path = String());
 
 	/**
 	 * @brief Destructor for the FileStream class.
@@ -32,6 +77,22 @@ public:
 	 */
 	~FileStream();
 
+	/**
+	 * @brief Move constructor. The file and buffers are taken over from `other`, which is left empty.
+	 * @param other The stream to move from.
+	 */
+	FileStream(FileStream &&other);
+
+	/**
+	 * @brief Move assignment. Any file already open in this stream is closed first.
+	 * @param other The stream to move from, which is left empty.
+	 * @return A reference to this stream.
+	 */
+	FileStream &operator=(FileStream &&other);
+
+	FileStream(const FileStream &) = delete;
+	FileStream &operator=(const FileStream &) = delete;
+
 	/**
 	 * @brief Check if the stream is in a good state.
 	 * @return True if the stream is good, false otherwise.
@@ -44,6 +105,20 @@ public:
 	 */
 	bool bad() const;
 
+	/**
+	 * @brief Check if the stream is waiting for the USB drive to come back.
+	 * Reads return nothing while this is true, but the stream is still good, and carries on once the drive is remounted.
+	 * @return True if the drive dropped out and the stream can be reopened, false otherwise.
+	 */
+	bool unavailable() const;
+
+	/**
+	 * @brief Change the path the file is opened from again after the drive is remounted,
+	 * e.g. because it has been renamed while the stream was open.
+	 * @param path The file's new path.
+	 */
+	void retarget(const String &path);
+
 	/**
 	 * @brief Check if the stream is in a good state.
 	 * @return True if the stream is good, false otherwise.
@@ -53,29 +128,68 @@ public:
 	}
 
 	/**
-	 * @brief Read data from the file stream.
+	 * @brief Read data from the file stream into caller-supplied memory.
 	 * @tparam T The type of data to read from the file.
-	 * @param chunkSize The size of the chunk to read.
-	 * @return A vector containing the read data.
+	 * @param buffer The buffer to read into. This must have room for at least `count` elements.
+	 * @param count The number of elements to read.
+	 * @return The number of elements read.
 	 */
 	template <typename T>
-	std::vector<T> read(int chunkSize = 1024) {
+	size_t readInto(T *buffer, size_t count) {
 		if (!file) {
 			logger::error("FileStream is not initialized.");
-			return {};
+			return 0;
 		}
 
-		std::vector<T> buffer(chunkSize);
-		size_t dataRead = fread(buffer.data(), sizeof(T), chunkSize, file);
-		if (dataRead == 0 && ferror(file)) {
-			logger::error("Error reading from file.");
-			return {};
+		// Only return whole elements, leaving any partial one to be read again.
+		const size_t bytesRead = readBytes(buffer, count * sizeof(T));
+		const size_t partial = bytesRead % sizeof(T);
+		if (partial) {
+			position -= partial;
+			if (!blockSize) {
+				fseek(file, position, SEEK_SET);
+			}
 		}
+		return bytesRead / sizeof(T);
+	}
 
-		buffer.resize(dataRead);
+	/**
+	 * @brief Read data from the file stream.
+	 * @tparam T The type of data to read from the file.
+	 * @param chunkSize The size of the chunk to read.
+	 * @return A vector containing the read data.
+	 */
+	template <typename T>
+	std::vector<T> read(int chunkSize = 1024) {
+		std::vector<T> buffer(chunkSize);
+		buffer.resize(readInto(buffer.data(), chunkSize));
 		return buffer;
 	}
 
+	/**
+	 * @brief Read ahead of the caller into a buffer owned by the stream.
+	 * Reads are rounded out to the filesystem's cluster size, so the buffer size is rounded up to a whole number of clusters.
+	 * The buffers are allocated here, so nothing is allocated while reading.
+	 * @param bytes The size of the read-ahead buffer in bytes, or 0 to read straight from the file.
+	 * @param doubleBuffer If true, allocate a second buffer so that prefetch() can fetch the next block before it's needed.
+	 * @return True if the buffers were set up, false otherwise.
+	 */
+	bool setReadAhead(size_t bytes = DEFAULT_READ_AHEAD, bool doubleBuffer = false);
+
+	/**
+	 * @brief Never read ahead past a point in the file, e.g. because the rest is still being written.
+	 * Reads up to the limit are buffered as usual, and blocks are topped up as the limit grows.
+	 * @param bytes The offset to stop reading ahead at.
+	 */
+	void setReadLimit(size_t bytes);
+
+	/**
+	 * @brief Fetch the block after the one being read into the spare buffer, if it isn't there already.
+	 * @return True if data was read from the file, false if there was nothing to do.
+	 * @note This does nothing unless the stream is double-buffered.
+	 */
+	bool prefetch();
+
 	/**
 	 * @brief Seek to a specific position in the file.
 	 * @param position The position to seek to in the file.
@@ -92,9 +206,16 @@ public:
 
 	/**
 	 * @brief Get the size of the file.
+	 * This is measured when the stream is opened, and grows if reads find more data.
 	 * @return The size of the file in bytes.
 	 */
 	size_t size() const;
+
+	/**
+	 * @brief Measure the size of the file again, e.g. after another stream has finished writing to it.
+	 * @return The size of the file in bytes.
+	 */
+	size_t refreshSize();
 };
 
 } // namespace fs
@@ -0,0 +1,294 @@
+#include "fileWriter.hpp"
+#include "../fs.hpp"
+#include <string.h>
+
+namespace fs {
+
+constexpr size_t FileWriter::DEFAULT_BUFFER;
+
+FileWriter::FileWriter(FILE *file, size_t bufferSize) : file(file), buffer(nullptr), capacity(0), buffered(0), alignment(1), flushed(0), writes(0), worker(nullptr), target(nullptr) {
+	if (!file) {
+		return;
+	}
+
+	// Appending carries on from the end of whatever is already there.
+	if (fseek(file, 0, SEEK_END) == 0) {
+		flushed = ftell(file);
+	}
+
+	alignment = clusterSize();
+	if (!alignment) {
+		alignment = 1;
+	}
+
+	capacity = (bufferSize + alignment - 1) / alignment * alignment;
+	if (!capacity) {
+		capacity = alignment;
+	}
+	buffer = new uint8_t[capacity];
+}
+
+FileWriter::FileWriter(FILE *file, WriteBehind &worker) : file(file), buffer(nullptr), capacity(0), buffered(0), alignment(1), flushed(0), writes(0), worker(&worker), target(nullptr) {
+	if (!file) {
+		return;
+	}
+
+	if (fseek(file, 0, SEEK_END) == 0) {
+		flushed = ftell(file);
+	}
+
+	// The worker's buffers are whole clusters of the drive it was started with. If this drive has larger clusters,
+	// align to the buffer size instead, so every buffer still fills up to a boundary.
+	capacity = worker.size();
+	alignment = clusterSize();
+	if (!alignment || capacity % alignment) {
+		alignment = capacity;
+	}
+
+	buffer = worker.acquire();
+	target = new WriteBehind::Target{file, flushed, 0, false};
+}
+
+FileWriter::~FileWriter() {
+	release();
+}
+
+FileWriter::FileWriter(FileWriter &&other) : file(other.file), buffer(other.buffer), capacity(other.capacity), buffered(other.buffered), alignment(other.alignment), flushed(other.flushed), writes(other.writes), worker(other.worker), target(other.target) {
+	other.file = nullptr;
+	other.buffer = nullptr;
+	other.buffered = 0;
+	other.target = nullptr;
+}
+
+FileWriter &FileWriter::operator=(FileWriter &&other) {
+	if (this == &other) {
+		return *this;
+	}
+
+	release();
+	file = other.file;
+	buffer = other.buffer;
+	capacity = other.capacity;
+	buffered = other.buffered;
+	alignment = other.alignment;
+	flushed = other.flushed;
+	writes = other.writes;
+	worker = other.worker;
+	target = other.target;
+
+	other.file = nullptr;
+	other.buffer = nullptr;
+	other.buffered = 0;
+	other.target = nullptr;
+	return *this;
+}
+
+void FileWriter::release() {
+	close();
+	if (worker && buffer) {
+		worker->release(buffer);
+	} else {
+		delete[] buffer;
+	}
+	buffer = nullptr;
+}
+
+bool FileWriter::good() const {
+	if (target) {
+		return file != nullptr && !worker->progress(*target).failed;
+	}
+	return file != nullptr && !ferror(file);
+}
+
+bool FileWriter::drain() {
+	if (!buffered) {
+		return true;
+	}
+
+	if (worker) {
+		// Swap in an empty buffer, and let the worker write the full one. Failures show up in good() and close().
+		worker->submit(*target, buffer, buffered);
+		writes++;
+		buffer = worker->acquire();
+		flushed += buffered;
+		buffered = 0;
+		return true;
+	}
+
+	const size_t count = fwrite(buffer, 1, buffered, file);
+	writes++;
+	flushed += count;
+	if (count != buffered) {
+		// Keep whatever didn't make it, so a later flush can try again.
+		memmove(buffer, buffer + count, buffered - count);
+		buffered -= count;
+		logger::error("Failed to write buffered data to file.");
+		return false;
+	}
+
+	buffered = 0;
+	return true;
+}
+
+bool FileWriter::write(const void *data, size_t bytes) {
+	if (!file) {
+		logger::error("FileWriter is not initialized.");
+		return false;
+	}
+
+	const uint8_t *in = static_cast<const uint8_t *>(data);
+	while (bytes) {
+		// Once the file is at a cluster boundary, whole buffers' worth can skip the copy.
+		// The worker owns the file while it has buffers queued, so this is only done when writing inline.
+		if (!worker && !buffered && flushed % alignment == 0 && bytes >= capacity) {
+			const size_t direct = bytes / alignment * alignment;
+			const size_t count = fwrite(in, 1, direct, file);
+			writes++;
+			flushed += count;
+			if (count != direct) {
+				logger::error("Failed to write to file.");
+				return false;
+			}
+			in += count;
+			bytes -= count;
+			continue;
+		}
+
+		// Fill up to the next cluster boundary, so every write to the file ends on one.
+		const size_t limit = capacity - flushed % alignment;
+		size_t count = limit - buffered;
+		if (count > bytes) {
+			count = bytes;
+		}
+
+		memcpy(buffer + buffered, in, count);
+		buffered += count;
+		in += count;
+		bytes -= count;
+
+		if (buffered == limit && !drain()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FileWriter::write(const std::vector<uint8_t> &data) {
+	return write(data.data(), data.size());
+}
+
+size_t FileWriter::writeSome(const void *data, size_t bytes) {
+	if (!worker) {
+		return write(data, bytes) ? bytes : 0;
+	}
+	if (!file) {
+		logger::error("FileWriter is not initialized.");
+		return 0;
+	}
+
+	// Only this thread submits buffers, so once the worker has room, it still has room when the buffer is handed over.
+	const uint8_t *in = static_cast<const uint8_t *>(data);
+	size_t taken = 0;
+	while (taken < bytes) {
+		const size_t limit = capacity - flushed % alignment;
+		if (buffered == limit) {
+			if (!worker->ready()) {
+				break;
+			}
+			drain();
+			continue;
+		}
+
+		size_t count = limit - buffered;
+		if (count > bytes - taken) {
+			count = bytes - taken;
+		}
+		memcpy(buffer + buffered, in + taken, count);
+		buffered += count;
+		taken += count;
+	}
+
+	// Hand over a buffer that has just filled up, rather than leaving it until the next call.
+	if (buffered == capacity - flushed % alignment && worker->ready()) {
+		drain();
+	}
+	return taken;
+}
+
+bool FileWriter::preallocate(uint64_t bytes) {
+	if (!file) {
+		logger::error("FileWriter is not initialized.");
+		return false;
+	}
+
+	if (bytes <= flushed + buffered) {
+		return true;
+	}
+
+	// Move the file position only while the worker isn't using it.
+	if (worker) {
+		worker->drain(*target);
+	}
+
+	// Writing the last byte makes the filesystem allocate every cluster before it.
+	const bool success = fseek(file, bytes - 1, SEEK_SET) == 0 && fputc(0, file) != EOF && fflush(file) == 0;
+	if (fseek(file, flushed, SEEK_SET) != 0 || !success) {
+		logger::error("Failed to preallocate file.");
+		return false;
+	}
+	return true;
+}
+
+bool FileWriter::flush() {
+	if (!file) {
+		return false;
+	}
+	if (worker) {
+		return drain();
+	}
+	return drain() && fflush(file) == 0;
+}
+
+bool FileWriter::close() {
+	if (!file) {
+		return true;
+	}
+
+	bool success = flush();
+	if (worker) {
+		worker->drain(*target);
+		success = success && !target->failed;
+		delete target;
+		target = nullptr;
+	}
+
+	fclose(file);
+	file = nullptr;
+	return success;
+}
+
+bool FileWriter::ready() const {
+	return !worker || worker->ready();
+}
+
+bool FileWriter::busy() const {
+	return target && worker->busy(*target);
+}
+
+size_t FileWriter::pending() const {
+	return buffered;
+}
+
+uint64_t FileWriter::written() const {
+	if (target) {
+		return worker->progress(*target).completed;
+	}
+	return flushed;
+}
+
+unsigned long FileWriter::transfers() const {
+	return writes;
+}
+
+} // namespace fs
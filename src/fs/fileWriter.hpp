@@ -0,0 +1,182 @@
+/// @file fileWriter.hpp
+#pragma once
+
+#include "../logger.hpp"
+#include "writeBehind.hpp"
+#include <vector>
+
+#ifdef EMULATE
+#include <cstdio>
+#else
+#include <Arduino_USBHostMbed5.h>
+#endif
+
+namespace fs {
+
+/**
+ * @brief A class to write to a file through a coalescing buffer.
+ * Writes are collected in memory and handed to the filesystem in cluster-sized, cluster-aligned pieces,
+ * so many small writes (e.g. network packets) cost a few large USB transfers, rather than one
+ * open, write, directory update and close each.
+ *
+ * The file stays open until the writer is closed or destroyed. Data still in the buffer isn't visible to readers
+ * of the file until flush() or close() is called.
+ *
+ * Given a WriteBehind, full buffers are handed to its worker thread instead of being written inline,
+ * so write() and flush() don't wait on the drive. written() then only counts what the worker has finished writing.
+ */
+class FileWriter {
+public:
+	/// The default size of the write buffer, in bytes.
+	static constexpr size_t DEFAULT_BUFFER = 16384;
+
+private:
+	FILE *file;
+	uint8_t *buffer;
+	size_t capacity;
+	size_t buffered;
+	size_t alignment;
+	uint64_t flushed;
+	unsigned long writes;
+	WriteBehind *worker;
+	WriteBehind::Target *target;
+
+	bool drain();
+	void release();
+
+public:
+	/**
+	 * @brief Constructor for the FileWriter class.
+	 * @param file A pointer to the file to write to, opened for writing or appending. If nullptr, it will not be initialized.
+	 * @param bufferSize The size of the write buffer in bytes. This is rounded up to a whole number of clusters.
+	 */
+	FileWriter(FILE *file = nullptr, size_t bufferSize = DEFAULT_BUFFER);
+
+	/**
+	 * @brief Constructor for a FileWriter whose full buffers are written by a background worker.
+	 * The buffers come from the worker, and are its size.
+	 * @param file A pointer to the file to write to, opened for writing or appending. If nullptr, it will not be initialized.
+	 * @param worker The worker to write the file. It must outlive the writer.
+	 */
+	FileWriter(FILE *file, WriteBehind &worker);
+
+	/**
+	 * @brief Destructor for the FileWriter class.
+	 * This will flush and close the file if it is open.
+	 */
+	~FileWriter();
+
+	/**
+	 * @brief Move constructor. The file and buffer are taken over from `other`, which is left empty.
+	 * @param other The writer to move from.
+	 */
+	FileWriter(FileWriter &&other);
+
+	/**
+	 * @brief Move assignment. Any file already open in this writer is flushed and closed first.
+	 * @param other The writer to move from, which is left empty.
+	 * @return A reference to this writer.
+	 */
+	FileWriter &operator=(FileWriter &&other);
+
+	FileWriter(const FileWriter &) = delete;
+	FileWriter &operator=(const FileWriter &) = delete;
+
+	/**
+	 * @brief Check if the writer is open and no write has failed.
+	 * @return True if the writer is good, false otherwise.
+	 */
+	bool good() const;
+
+	/**
+	 * @brief Check if the writer is in a good state.
+	 * @return True if the writer is good, false otherwise.
+	 */
+	inline operator bool() const {
+		return good();
+	}
+
+	/**
+	 * @brief Append data to the file.
+	 * @param data The data to write.
+	 * @param bytes The number of bytes to write.
+	 * @return True if the data was buffered or written, false otherwise.
+	 */
+	bool write(const void *data, size_t bytes);
+
+	/**
+	 * @brief Append binary data to the file.
+	 * @param data The data to write.
+	 * @return True if the data was buffered or written, false otherwise.
+	 */
+	bool write(const std::vector<uint8_t> &data);
+
+	/**
+	 * @brief Append as much data as can be taken without waiting for the worker.
+	 * Data is buffered until the buffer is full and the worker's queue has no room for it, then this returns early,
+	 * so the caller can hold on to the rest and offer it again later. Without a worker, this is the same as write().
+	 * @param data The data to write.
+	 * @param bytes The number of bytes to write.
+	 * @return The number of bytes taken, which may be fewer than `bytes`.
+	 */
+	size_t writeSome(const void *data, size_t bytes);
+
+	/**
+	 * @brief Reserve space for the whole file up front.
+	 * The filesystem allocates every cluster in one go, so the file is likely to be contiguous
+	 * rather than fragmented by other files written while it grows. Writing carries on from the same place.
+	 * @param bytes The final size of the file in bytes.
+	 * @return True if the space was reserved, false otherwise.
+	 * @note The file is this size from then on, even if less is written. This only works for files opened for overwriting, not appending.
+	 */
+	bool preallocate(uint64_t bytes);
+
+	/**
+	 * @brief Hand any buffered data to the filesystem, so that readers of the file can see it.
+	 * With a worker, this waits for room in its queue, so check ready() first to avoid waiting.
+	 * @return True if successful, false otherwise.
+	 * @note This writes a partial cluster, so it's best saved for when no more data is coming for a while.
+	 */
+	bool flush();
+
+	/**
+	 * @brief Flush any buffered data and close the file.
+	 * With a worker, this waits for it to finish writing the file.
+	 * @return True if everything was written, false otherwise.
+	 */
+	bool close();
+
+	/**
+	 * @brief Check if another full buffer can be handed over without waiting.
+	 * @return True if there is no worker, or its queue has room, false otherwise.
+	 * @note Callers should stop taking in data while this is false, to let the worker catch up.
+	 */
+	bool ready() const;
+
+	/**
+	 * @brief Check if the worker still has data to write for this file.
+	 * @return True if there are full buffers still waiting to be written, false otherwise (or if there is no worker).
+	 */
+	bool busy() const;
+
+	/**
+	 * @brief Get the number of bytes waiting in the buffer.
+	 * @return The number of buffered bytes.
+	 */
+	size_t pending() const;
+
+	/**
+	 * @brief Get the size of the file as far as readers can see, i.e. not counting buffered data,
+	 * or data still waiting for the worker.
+	 * @return The number of bytes in the file.
+	 */
+	uint64_t written() const;
+
+	/**
+	 * @brief Get the number of writes made to the file so far, including those handed to the worker.
+	 * @return The number of writes.
+	 */
+	unsigned long transfers() const;
+};
+
+} // namespace fs
@@ -0,0 +1,113 @@
+#include "mappedStream.hpp"
+
+#ifdef FS_MMAP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs {
+
+MappedStream::MappedStream(int descriptor) : mapping(nullptr), length(0), position(0), open(false) {
+	if (descriptor < 0) {
+		return;
+	}
+
+	struct stat st;
+	if (fstat(descriptor, &st) != 0) {
+		logger::error("Failed to get the size of a file to map.");
+		return;
+	}
+
+	// Empty files can't be mapped, but they're still valid streams with nothing in them.
+	length = st.st_size;
+	if (length) {
+		void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (address == MAP_FAILED) {
+			logger::error("Failed to map file.");
+			length = 0;
+			return;
+		}
+		mapping = static_cast<const uint8_t *>(address);
+
+		// Audio is read from start to end, so let the kernel read ahead further and drop pages behind us.
+		madvise(address, length, MADV_SEQUENTIAL);
+	}
+
+	open = true;
+}
+
+MappedStream::~MappedStream() {
+	release();
+}
+
+MappedStream::MappedStream(MappedStream &&other) : mapping(other.mapping), length(other.length), position(other.position), open(other.open) {
+	other.mapping = nullptr;
+	other.length = 0;
+	other.position = 0;
+	other.open = false;
+}
+
+MappedStream &MappedStream::operator=(MappedStream &&other) {
+	if (this == &other) {
+		return *this;
+	}
+
+	release();
+	mapping = other.mapping;
+	length = other.length;
+	position = other.position;
+	open = other.open;
+
+	other.mapping = nullptr;
+	other.length = 0;
+	other.position = 0;
+	other.open = false;
+	return *this;
+}
+
+void MappedStream::release() {
+	if (mapping) {
+		munmap(const_cast<uint8_t *>(mapping), length);
+	}
+	mapping = nullptr;
+	length = 0;
+	position = 0;
+	open = false;
+}
+
+bool MappedStream::good() const {
+	return open;
+}
+
+const uint8_t *MappedStream::data() const {
+	return mapping;
+}
+
+bool MappedStream::seek(size_t position, int flag) {
+	if (!open) {
+		logger::error("MappedStream is not initialized.");
+		return false;
+	}
+
+	const long base = flag == SEEK_CUR ? this->position : flag == SEEK_END ? length : 0;
+	const long target = base + static_cast<long>(position);
+	if (target < 0) {
+		logger::error("Failed to seek in file.");
+		return false;
+	}
+
+	this->position = target;
+	return true;
+}
+
+size_t MappedStream::tell() const {
+	return position;
+}
+
+size_t MappedStream::size() const {
+	return length;
+}
+
+} // namespace fs
+
+#endif
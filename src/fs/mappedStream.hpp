@@ -0,0 +1,149 @@
+/// @file mappedStream.hpp
+#pragma once
+
+#include "../logger.hpp"
+#include <vector>
+
+#if defined(EMULATE) && (defined(__unix__) || defined(__APPLE__))
+/// Defined when files can be memory mapped, i.e. when emulating on a POSIX host such as Linux.
+#define FS_MMAP 1
+#endif
+
+#ifdef FS_MMAP
+
+#include <stdio.h>
+#include <string.h>
+
+namespace fs {
+
+/**
+ * @brief A read-only stream over a memory-mapped file, with the same reading API as FileStream.
+ *
+ * The whole file is mapped when the stream is opened, and the kernel is told it will be read sequentially,
+ * so it reads ahead aggressively and drops pages once they've been read. Reads are a copy straight out of the
+ * page cache, with no stdio buffer in between, and data() gives direct access for readers that don't need a copy at all.
+ *
+ * This is only available when emulating on a POSIX host (see FS_MMAP). It maps a snapshot of the file's size,
+ * so it is not suitable for files that are still being written.
+ */
+class MappedStream {
+	const uint8_t *mapping;
+	size_t length;
+	size_t position;
+	bool open;
+
+	void release();
+
+public:
+	/**
+	 * @brief Constructor for the MappedStream class.
+	 * @param descriptor A file descriptor opened for reading, or -1 for an empty stream.
+	 * The file is mapped, and the descriptor can be closed afterwards.
+	 */
+	MappedStream(int descriptor = -1);
+
+	/**
+	 * @brief Destructor for the MappedStream class.
+	 * This will unmap the file if it is mapped.
+	 */
+	~MappedStream();
+
+	/**
+	 * @brief Move constructor. The mapping is taken over from `other`, which is left empty.
+	 * @param other The stream to move from.
+	 */
+	MappedStream(MappedStream &&other);
+
+	/**
+	 * @brief Move assignment. Any file already mapped by this stream is unmapped first.
+	 * @param other The stream to move from, which is left empty.
+	 * @return A reference to this stream.
+	 */
+	MappedStream &operator=(MappedStream &&other);
+
+	MappedStream(const MappedStream &) = delete;
+	MappedStream &operator=(const MappedStream &) = delete;
+
+	/**
+	 * @brief Check if the stream is in a good state.
+	 * @return True if the file is mapped, false otherwise.
+	 */
+	bool good() const;
+
+	/**
+	 * @brief Check if the stream is in a good state.
+	 * @return True if the stream is good, false otherwise.
+	 */
+	inline operator bool() const {
+		return good();
+	}
+
+	/**
+	 * @brief Read data from the stream into caller-supplied memory.
+	 * @tparam T The type of data to read from the file.
+	 * @param buffer The buffer to read into. This must have room for at least `count` elements.
+	 * @param count The number of elements to read.
+	 * @return The number of elements read.
+	 */
+	template <typename T>
+	size_t readInto(T *buffer, size_t count) {
+		if (!open) {
+			logger::error("MappedStream is not initialized.");
+			return 0;
+		}
+
+		// Only return whole elements, leaving any partial one to be read again.
+		const size_t available = position < length ? (length - position) / sizeof(T) : 0;
+		if (count > available) {
+			count = available;
+		}
+		if (count) {
+			memcpy(buffer, mapping + position, count * sizeof(T));
+			position += count * sizeof(T);
+		}
+		return count;
+	}
+
+	/**
+	 * @brief Read data from the stream.
+	 * @tparam T The type of data to read from the file.
+	 * @param chunkSize The size of the chunk to read.
+	 * @return A vector containing the read data.
+	 */
+	template <typename T>
+	std::vector<T> read(int chunkSize = 1024) {
+		std::vector<T> buffer(chunkSize);
+		buffer.resize(readInto(buffer.data(), chunkSize));
+		return buffer;
+	}
+
+	/**
+	 * @brief Get direct access to the whole file.
+	 * @return A pointer to the first byte of the file, or nullptr if nothing is mapped (including empty files).
+	 */
+	const uint8_t *data() const;
+
+	/**
+	 * @brief Seek to a specific position in the file.
+	 * @param position The position to seek to in the file.
+	 * @param flag The seek mode (SEEK_SET, SEEK_CUR, SEEK_END).
+	 * @return True if the seek was successful, false otherwise.
+	 */
+	bool seek(size_t position, int flag = SEEK_SET);
+
+	/**
+	 * @brief Get the current position in the file.
+	 * @return The current position in the file.
+	 */
+	size_t tell() const;
+
+	/**
+	 * @brief Get the size of the file.
+	 * @return The size of the file in bytes, as it was when it was mapped.
+	 */
+	size_t size() const;
+};
+
+} // namespace fs
+
+#endif
@@ -1,12 +1,20 @@
 #include "path.hpp"
 
+#include <errno.h>
+#include <string.h>
+
 #ifdef EMULATE
 #include <sys/stat.h>
 #endif
 
+#ifdef FS_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace fs {
 
-IterDir::IterDir(const Path &parent, const String &path, bool end) : parent(parent) {
+IterDir::IterDir(const Path &parent, const String &path, bool end) : parent(parent), mount(generation()) {
 	dir = nullptr;
 	entry = nullptr;
 
@@ -14,12 +22,14 @@ IterDir::IterDir(const Path &parent, const String &path, bool end) : parent(pare
 		dir = opendir(_path(path).c_str());
 		if (dir) {
 			entry = readdir(dir);
+			skipDots();
 		}
 	}
 }
 
 IterDir::~IterDir() {
-	if (dir && connected()) {
+	// Even if the drive has been remounted since, the handle still holds memory, so it is always closed.
+	if (dir) {
 		closedir(dir);
 	}
 }
@@ -29,13 +39,23 @@ bool IterDir::operator!=(const IterDir &other) const {
 }
 
 IterDir &IterDir::operator++() {
-	if (dir) {
+	if (dir && (!connected() || mount != generation())) {
+		// The drive dropped out, so end the listing early rather than reading from a dead handle.
+		entry = nullptr;
+	} else if (dir) {
 		entry = readdir(dir);
+		skipDots();
 	}
 	return *this;
 }
 
-Path::Path(const String &path) {
+void IterDir::skipDots() {
+	while (entry && entry->d_name[0] == '.' && (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+		entry = readdir(dir);
+	}
+}
+
+Path::Path(const String &path) : cache{UNKNOWN_TYPE, 0, 0}, cached(false), mount(generation()) {
 	if (path.endsWith("/")) {
 		this->path = path.substring(0, path.length() - 1); // Remove trailing slash
 	} else {
@@ -43,34 +63,58 @@ Path::Path(const String &path) {
 	}
 }
 
-bool Path::exists() const {
-	if (!fs::connected()) {
-		return false;
+Path::Path(const String &path, FileType type) : Path(path) {
+	cache.type = type;
+}
+
+FileType Path::type() const {
+	if (cache.type == UNKNOWN_TYPE || mount != generation()) {
+		return info().type;
 	}
-	struct stat st;
-	return stat(_path(path).c_str(), &st) == 0;
+	return cache.type;
 }
 
-bool Path::isDir() const {
+const FileInfo &Path::info() const {
+	if (cached && mount == generation()) {
+		return cache;
+	}
+
 	if (!fs::connected()) {
-		return false;
+		// Not cached, so the path is looked up again once the drive is connected.
+		static const FileInfo missing = {NOT_FOUND, 0, 0};
+		return missing;
 	}
+
 	struct stat st;
 	if (stat(_path(path).c_str(), &st) != 0) {
-		return false;
+		cache = {NOT_FOUND, 0, 0};
+	} else if (S_ISREG(st.st_mode)) {
+		cache = {REGULAR_FILE, static_cast<size_t>(st.st_size), st.st_mtime};
+	} else if (S_ISDIR(st.st_mode)) {
+		cache = {DIRECTORY, static_cast<size_t>(st.st_size), st.st_mtime};
+	} else {
+		cache = {OTHER_TYPE, static_cast<size_t>(st.st_size), st.st_mtime};
 	}
-	return S_ISDIR(st.st_mode);
+	cached = true;
+	mount = generation();
+	return cache;
+}
+
+void Path::invalidate() const {
+	cache = {UNKNOWN_TYPE, 0, 0};
+	cached = false;
+}
+
+bool Path::exists() const {
+	return fs::connected() && type() != NOT_FOUND;
+}
+
+bool Path::isDir() const {
+	return fs::connected() && type() == DIRECTORY;
 }
 
 bool Path::isFile() const {
-	if (!fs::connected()) {
-		return false;
-	}
-	struct stat st;
-	if (stat(_path(path).c_str(), &st) != 0) {
-		return false;
-	}
-	return S_ISREG(st.st_mode);
+	return fs::connected() && type() == REGULAR_FILE;
 }
 
 Path Path::operator/(const String &subPath) const {
@@ -79,6 +123,7 @@ Path Path::operator/(const String &subPath) const {
 
 Path &Path::operator/=(const String &subPath) {
 	path += "/" + subPath;
+	invalidate();
 	return *this;
 }
 
@@ -131,16 +176,29 @@ String Path::read() const {
 		return "";
 	}
 
-	auto file = fopen(_path(path).c_str(), "r");
+	const int length = size();
+	if (length < 0) {
+		return "";
+	}
+
+	auto file = fopen(_path(path).c_str(), "rb");
 	if (!file) {
 		logger::error("Failed to open file for reading: " + path);
 		return "";
 	}
 
+	// Size the string once up front, then copy into it in bulk.
 	String content;
-	char buffer[256];
-	while (fgets(buffer, sizeof(buffer), file)) {
-		content += buffer;
+	if (!content.reserve(length)) {
+		logger::error("Not enough memory to read file: " + path);
+		fclose(file);
+		return "";
+	}
+
+	char buffer[512];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		content.concat(buffer, count);
 	}
 
 	fclose(file);
@@ -148,28 +206,45 @@ String Path::read() const {
 }
 
 std::vector<String> Path::readlines() const {
+	std::vector<String> lines;
+	for (const String &line : this->lines()) {
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+std::vector<uint8_t> Path::readBytes() const {
 	if (!connected()) {
 		return {};
 	}
 
-	std::vector<String> lines;
-	String data = read();
-	if (data.isEmpty()) {
-		return lines; // Return empty vector if no data
+	auto file = fopen(_path(path).c_str(), "rb");
+	if (!file) {
+		// A missing file just reads as empty.
+		if (errno != ENOENT) {
+			logger::error("Failed to open file for reading: " + path);
+		}
+		return {};
 	}
 
-	size_t index = 0;
-	while (index < data.length()) {
-		int nextIndex = data.indexOf('\n', index);
-		if (nextIndex == -1) {
-			lines.push_back(data.substring(index));
-			break; // No more newlines, add the rest
-		}
-		lines.push_back(data.substring(index, nextIndex));
-		index = nextIndex + 1; // Move past the newline
+	// Measure the open file rather than trusting the cached size, since the file may have grown since.
+	long length = -1;
+	if (fseek(file, 0, SEEK_END) == 0) {
+		length = ftell(file);
+	}
+	if (length <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+		fclose(file);
+		return {};
 	}
 
-	return lines;
+	std::vector<uint8_t> data(length);
+	data.resize(fread(data.data(), 1, data.size(), file));
+	fclose(file);
+	return data;
+}
+
+Lines Path::lines() const {
+	return Lines(*this);
 }
 
 bool Path::write(const String &data, bool append) const {
@@ -177,6 +252,7 @@ bool Path::write(const String &data, bool append) const {
 		return false;
 	}
 
+	invalidate();
 	auto file = fopen(_path(path).c_str(), append ? "a" : "w");
 	if (!file) {
 		logger::error("Failed to open file for writing: " + path);
@@ -199,6 +275,7 @@ bool Path::write(const std::vector<uint8_t> &data, bool append) const {
 		return false;
 	}
 
+	invalidate();
 	auto file = fopen(_path(path).c_str(), append ? "ab" : "wb");
 	if (!file) {
 		logger::error("Failed to open file for writing: " + path);
@@ -233,6 +310,7 @@ bool Path::mkdir(bool exist_ok) const {
 		return false;
 	}
 
+	invalidate();
 	if (::mkdir(_path(path).c_str(), 0755) != 0) {
 		logger::error("Failed to create directory: " + path);
 		return false;
@@ -245,12 +323,12 @@ int Path::size() const {
 		return -1;
 	}
 
-	struct stat st;
-	if (stat(_path(path).c_str(), &st) != 0) {
+	const FileInfo &i = info();
+	if (i.type == NOT_FOUND) {
 		logger::error("Failed to get file size: " + path);
 		return -1;
 	}
-	return st.st_size;
+	return i.size;
 }
 
 bool Path::unlink(bool recurse) const {
@@ -267,6 +345,7 @@ bool Path::unlink(bool recurse) const {
 		}
 	}
 
+	invalidate();
 	if (remove(_path(path).c_str()) != 0) {
 		logger::error("Failed to remove path: " + path);
 		return false;
@@ -274,19 +353,89 @@ bool Path::unlink(bool recurse) const {
 	return true;
 }
 
+bool Path::rename(const Path &to, bool replace) const {
+	if (!connected()) {
+		return false;
+	}
+
+	// Both paths change, and either may have been copied along with an out of date stat.
+	invalidate();
+	to.invalidate();
+
+	// FAT can't rename over an existing file, so any file in the way has to go first.
+	if (to.exists()) {
+		if (!replace) {
+			logger::error("Path already exists: " + to.path);
+			return false;
+		}
+		if (!to.unlink()) {
+			return false;
+		}
+	}
+
+	const bool renamed = ::rename(_path(path).c_str(), _path(to.path).c_str()) == 0;
+	to.invalidate();
+	if (!renamed) {
+		logger::error("Failed to rename path: " + path + " to " + to.path);
+		return false;
+	}
+	return true;
+}
+
 FileStream Path::stream() const {
 	if (!connected()) {
 		logger::error("FileStream is not connected to a USB device.");
 		return FileStream();
 	}
 
-	auto file = fopen(_path(path).c_str(), "r");
+	auto file = fopen(_path(path).c_str(), "rb");
 	if (!file) {
 		logger::error("Failed to open file for streaming: " + path);
 		return FileStream();
 	}
 
-	return FileStream(file);
+	return FileStream(file, path);
+}
+
+#ifdef FS_MMAP
+MappedStream Path::map() const {
+	if (!connected()) {
+		logger::error("MappedStream is not connected to a USB device.");
+		return MappedStream();
+	}
+
+	const int descriptor = ::open(_path(path).c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		logger::error("Failed to open file for mapping: " + path);
+		return MappedStream();
+	}
+
+	// The mapping keeps the file open by itself.
+	MappedStream stream(descriptor);
+	::close(descriptor);
+	return stream;
+}
+#endif
+
+FileWriter Path::writer(bool append, WriteBehind *worker) const {
+	if (!connected()) {
+		logger::error("FileWriter is not connected to a USB device.");
+		return FileWriter();
+	}
+
+	invalidate();
+	auto file = fopen(_path(path).c_str(), append ? "ab" : "wb");
+	if (!file) {
+		logger::error("Failed to open file for writing: " + path);
+		return FileWriter();
+	}
+
+	// The writer does its own buffering, so stdio's would only add a copy.
+	setvbuf(file, nullptr, _IONBF, 0);
+	if (worker) {
+		return FileWriter(file, *worker);
+	}
+	return FileWriter(file);
 }
 
 IterDir Path::begin() const {
@@ -299,9 +448,85 @@ IterDir Path::end() const {
 
 const Path IterDir::operator*() const {
 	if (entry) {
-		return parent / String(entry->d_name);
+		// The listing already says what each entry is, which saves a stat per entry when walking a directory.
+		FileType type;
+		switch (entry->d_type) {
+		case DT_REG:
+			type = REGULAR_FILE;
+			break;
+		case DT_DIR:
+			type = DIRECTORY;
+			break;
+		case DT_UNKNOWN:
+			type = UNKNOWN_TYPE;
+			break;
+		default:
+			type = OTHER_TYPE;
+			break;
+		}
+		return Path(parent.str() + "/" + entry->d_name, type);
 	}
 	return Path(""); // Return an empty path if no entry
 }
 
+IterLines::IterLines(FileStream &&stream) : stream(std::move(stream)), start(0), end(0), eof(false), done(false) {
+	if (!this->stream) {
+		done = true;
+		return;
+	}
+	++*this;
+}
+
+bool IterLines::operator!=(const IterLines &) const {
+	return !done;
+}
+
+IterLines &IterLines::operator++() {
+	if (eof) {
+		done = true;
+		return *this;
+	}
+
+	line = "";
+	while (true) {
+		if (start >= end) {
+			start = 0;
+			end = stream.readInto(buffer, sizeof(buffer));
+			if (!end) {
+				// Only a final line without a newline is left, if anything.
+				eof = true;
+				done = line.isEmpty();
+				return *this;
+			}
+		}
+
+		const char *newline = static_cast<const char *>(memchr(buffer + start, '\n', end - start));
+		const size_t stop = newline ? newline - buffer : end;
+		line.concat(buffer + start, stop - start);
+		start = stop;
+
+		if (newline) {
+			start++; // Move past the newline
+			return *this;
+		}
+	}
+}
+
+const String &IterLines::operator*() const {
+	return line;
+}
+
+Lines::Lines(const Path &path) : path(path) {}
+
+IterLines Lines::begin() const {
+	if (!path.isFile()) {
+		return IterLines(FileStream());
+	}
+	return IterLines(path.stream());
+}
+
+IterLines Lines::end() const {
+	return IterLines(FileStream());
+}
+
 } // namespace fs
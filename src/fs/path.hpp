@@ -3,21 +3,54 @@
 
 #include "../fs.hpp"
 
+#include <time.h>
+
 #ifdef EMULATE
 #include <dirent.h>
 #endif
 
 namespace fs {
 
-class Path; // Forward declaration
+class Path;  // Forward declaration
+class Lines; // Forward declaration
+
+/// The type of a filesystem entry.
+enum FileType {
+	/// The type has not been looked up yet.
+	UNKNOWN_TYPE,
+	/// Nothing exists at the path.
+	NOT_FOUND,
+	/// A regular file.
+	REGULAR_FILE,
+	/// A directory.
+	DIRECTORY,
+	/// Anything else, such as a device.
+	OTHER_TYPE,
+};
+
+/**
+ * @brief The result of looking up a path on the filesystem.
+ */
+struct FileInfo {
+	/// The type of the entry.
+	FileType type;
+	/// The size of the entry, in bytes.
+	size_t size;
+	/// The time the entry was last modified, or 0 if the filesystem does not record it.
+	time_t modified;
+};
 
 /**
  * @brief An iterator class for iterating over directories.
  * This class allows iteration over the contents of a directory,
  * and is provided to work with the range-based for loop syntax.
+ * The "." and ".." entries are skipped. Each entry already knows its type from the directory listing,
+ * so checking isDir() or isFile() on it does not stat the file again.
+ * If the USB drive drops out part way through, the listing ends early.
  */
 class IterDir {
 	const Path &parent;
+	unsigned long mount;
 	DIR *dir;
 	struct dirent *entry;
 
@@ -50,17 +83,85 @@ public:
 
 	/**
 	 * @brief Dereference the iterator to get the current Path object.
-	 * @return The current Path object.
+	 * @return The current Path object, with its type filled in if the filesystem reports it.
 	 */
 	const Path operator*() const;
+
+private:
+	/// Skip forward past the "." and ".." entries.
+	void skipDots();
+};
+
+/**
+ * @brief An iterator class for reading a file one line at a time.
+ * Lines are read through a small fixed buffer, so the file is never loaded into memory all at once.
+ * Lines are split on '\n', which is not included in the line. A final line without a newline is still returned.
+ */
+class IterLines {
+	FileStream stream;
+	String line;
+	char buffer[256];
+	size_t start;
+	size_t end;
+	bool eof;
+	bool done;
+
+public:
+	/**
+	 * @brief Constructor for the IterLines class. This reads the first line.
+	 * @param stream The stream to read lines from. If empty, the iterator is initialized to the end state.
+	 */
+	IterLines(FileStream &&stream);
+
+	/**
+	 * @brief Check if the iterator is at the end.
+	 * @return True if there is a line to read, false otherwise.
+	 */
+	bool operator!=(const IterLines &other) const;
+
+	/**
+	 * @brief Read the next line.
+	 * @return A reference to the current iterator.
+	 */
+	IterLines &operator++();
+
+	/**
+	 * @brief Dereference the iterator to get the current line.
+	 * @return The current line, without its newline.
+	 */
+	const String &operator*() const;
 };
 
 /**
  * @brief A class to represent a file path.
  * This class provides methods to manipulate and traverse files and directories.
+ *
+ * The file's type, size and modification time are looked up with a single stat the first time they are needed,
+ * and cached until the path is changed through this object, invalidate() is called, or the drive is remounted.
+ * Changes made through another Path object, or by another program, are not seen until then.
+ * Copying a Path copies its cached stat too, so a copy kept for later should be invalidated before it is trusted.
  */
 class Path {
+	friend class IterDir;
+
 	String path;
+	mutable FileInfo cache;
+	mutable bool cached;
+	/// The mount the cached information was read on. Anything read on an earlier mount is out of date.
+	mutable unsigned long mount;
+
+	/**
+	 * @brief Constructor for a Path whose type is already known, such as from a directory listing.
+	 * @param path The file path to be represented by this Path object.
+	 * @param type The type of the entry, or UNKNOWN_TYPE to look it up when needed.
+	 */
+	Path(const String &path, FileType type);
+
+	/**
+	 * @brief Get the type of the entry, without a stat if it is already known.
+	 * @return The type of the entry.
+	 */
+	FileType type() const;
 
 public:
 	/**
@@ -69,6 +170,19 @@ public:
 	 */
 	Path(const String &path);
 
+	/**
+	 * @brief Get the type, size and modification time of the entry at this path.
+	 * The filesystem is only queried the first time, after which the cached result is returned.
+	 * @return The information about the entry. If nothing exists at the path, its type is NOT_FOUND.
+	 */
+	const FileInfo &info() const;
+
+	/**
+	 * @brief Forget the cached information about this path, so the next query reads it from the filesystem again.
+	 * This is needed after the file is changed through another Path object, or by another program.
+	 */
+	void invalidate() const;
+
 	/**
 	 * @brief Check if the path exists.
 	 * @return True if the path exists, false otherwise.
@@ -96,6 +210,7 @@ public:
 
 	/**
 	 * @brief Append a sub-path to the current path in place.
+	 * This clears the cached information about the path.
 	 * @param subPath The sub-path to append.
 	 * @return A reference to the current Path object.
 	 */
@@ -155,6 +270,22 @@ public:
 	 */
 	std::vector<String> readlines() const;
 
+	/**
+	 * @brief Read the contents of the file at this path as raw bytes.
+	 * @return The contents of the file.
+	 *
+	 * @note If the path is not a file or does not exist, an empty vector is returned.
+	 * @warning This function will block until the entire file is read.
+	 */
+	std::vector<uint8_t> readBytes() const;
+
+	/**
+	 * @brief Get the lines of the file at this path, to iterate over without loading the whole file.
+	 * @return An object for iterating over the lines, with a range-based for loop.
+	 * @note If the path is not a file or does not exist, there are no lines.
+	 */
+	Lines lines() const;
+
 	/**
 	 * @brief Write data to the file at this path.
 	 * @param data The data to write to the file.
@@ -192,6 +323,16 @@ public:
 	 */
 	bool unlink(bool recurse = false) const;
 
+	/**
+	 * @brief Move the file or directory at this path to another path.
+	 * @param to The path to move it to.
+	 * @param replace If true, remove any file already at the new path first; if false, fail if there is one.
+	 * @return True if the move was successful, false otherwise.
+	 * @note FAT can't rename over an existing file, so replacing one is not atomic: if this is interrupted
+	 * after the old file has been removed, only the file at this path is left.
+	 */
+	bool rename(const Path &to, bool replace = false) const;
+
 	/**
 	 * @brief Get a file stream for the file at this path.
 	 * @return A FileStream object for the file.
@@ -199,6 +340,25 @@ public:
 	 */
 	FileStream stream() const;
 
+#ifdef FS_MMAP
+	/**
+	 * @brief Map the file at this path into memory, for reading without stdio.
+	 * @return A MappedStream object for the file.
+	 * @note If the path is not a file or does not exist, the MappedStream will be empty.
+	 * Only available when emulating on a POSIX host.
+	 */
+	MappedStream map() const;
+#endif
+
+	/**
+	 * @brief Get a buffered writer for the file at this path, which keeps the file open between writes.
+	 * @param append If true, append to the file; if false, overwrite the file.
+	 * @param worker If given, full buffers are written by this background worker instead of inline.
+	 * @return A FileWriter object for the file.
+	 * @note If the file cannot be opened, the FileWriter will be empty.
+	 */
+	FileWriter writer(bool append = false, WriteBehind *worker = nullptr) const;
+
 	/**
 	 * @brief Get an iterator for the directory contents.
 	 * @return An IterDir object for iterating over the directory contents.
@@ -213,4 +373,31 @@ public:
 	IterDir end() const;
 };
 
+/**
+ * @brief The lines of a file, as returned by Path::lines().
+ * The file is opened when iteration begins.
+ */
+class Lines {
+	Path path;
+
+public:
+	/**
+	 * @brief Constructor for the Lines class.
+	 * @param path The path of the file to read.
+	 */
+	Lines(const Path &path);
+
+	/**
+	 * @brief Open the file and read the first line.
+	 * @return An iterator at the first line.
+	 */
+	IterLines begin() const;
+
+	/**
+	 * @brief Get an end iterator for the lines.
+	 * @return An IterLines object representing the end of the file.
+	 */
+	IterLines end() const;
+};
+
 } // namespace fs
@@ -0,0 +1,426 @@
+#include "store.hpp"
+#include "../util/hash.hpp"
+#include <stdio.h>
+#include <string.h>
+
+// The first bytes of every store file, so that some other file is never mistaken for one.
+#define STORE_MAGIC "KVS1"
+#define STORE_MAGIC_SIZE 4
+
+// The size of a record's header: its checksum, key length, flags and value length.
+#define STORE_HEADER_SIZE 12
+
+// The flag for a record that removes its key, rather than giving it a value.
+#define STORE_ERASED 1
+
+// The extension of a compacted file that has not replaced the store yet.
+#define STORE_COMPACT_EXT ".tmp"
+
+// How much of the file has to be out of date before it is compacted automatically, in bytes.
+// Below this, compacting would cost more than the space it saves.
+#define STORE_COMPACT_MIN 4096
+
+// The number of slots in the index when the first key is added.
+#define STORE_MIN_SLOTS 16
+
+namespace fs {
+
+constexpr size_t Store::MAX_KEY;
+constexpr size_t Store::MAX_VALUE;
+
+/// Update a CRC-32 (the same one as zip and PNG) with more data. This works four bits at a time, to keep the table small.
+static uint32_t crc32(uint32_t crc, const void *data, size_t bytes) {
+	static const uint32_t table[16] = {
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+	};
+
+	const uint8_t *byte = static_cast<const uint8_t *>(data);
+	while (bytes--) {
+		crc ^= *byte++;
+		crc = (crc >> 4) ^ table[crc & 0xF];
+		crc = (crc >> 4) ^ table[crc & 0xF];
+	}
+	return crc;
+}
+
+/// Get the checksum of a record, covering everything after the checksum itself.
+static uint32_t checksum(const uint8_t *header, const void *body, size_t bytes) {
+	const uint32_t crc = crc32(0xFFFFFFFF, header + 4, STORE_HEADER_SIZE - 4);
+	return crc32(crc, body, bytes) ^ 0xFFFFFFFF;
+}
+
+/// Hash a key, mixed so that keys differing only at the end still spread over the whole table.
+static uint32_t hashKey(const char *key, size_t length) {
+	return mix32(fnv1a32(key, length));
+}
+
+// Records are little-endian, whatever the host, so the file can be moved between the board and an emulator.
+static void write16(uint8_t *out, uint16_t value) {
+	out[0] = value;
+	out[1] = value >> 8;
+}
+
+static void write32(uint8_t *out, uint32_t value) {
+	write16(out, value);
+	write16(out + 2, value >> 16);
+}
+
+static uint16_t read16(const uint8_t *in) {
+	return in[0] | (in[1] << 8);
+}
+
+static uint32_t read32(const uint8_t *in) {
+	return read16(in) | (static_cast<uint32_t>(read16(in + 2)) << 16);
+}
+
+Store::Store(const Path &file) : file(file), log(nullptr), mount(0), count(0), end(0), live(0) {
+	if (!load() && log) {
+		fclose(log);
+		log = nullptr;
+	}
+}
+
+Store::~Store() {
+	if (log) {
+		fclose(log);
+	}
+}
+
+bool Store::load() {
+	if (!connected()) {
+		logger::error("Store is not connected to a USB device.");
+		return false;
+	}
+
+	// A compacted file is only left behind if compaction was interrupted. Once the old file has been removed,
+	// the new one is complete, so finish the job. Otherwise, the old file is still the store.
+	const Path partial(file.str() + STORE_COMPACT_EXT);
+	if (partial.exists()) {
+		if (file.exists() || !partial.rename(file)) {
+			partial.unlink();
+		}
+	}
+
+	if (!file.exists() && !file.write(String(STORE_MAGIC))) {
+		logger::error("Failed to create store: " + file.str());
+		return false;
+	}
+
+	FileStream stream = file.stream();
+	if (!stream || !attach()) {
+		return false;
+	}
+	stream.setReadAhead();
+
+	char magic[STORE_MAGIC_SIZE];
+	if (stream.readInto(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, STORE_MAGIC, sizeof(magic)) != 0) {
+		logger::error("Not a store file: " + file.str());
+		return false;
+	}
+
+	// Replay the log to find the latest record for each key. Appends only ever go on the end,
+	// so the first record that doesn't check out is where an interrupted update stopped, and nothing after it is valid.
+	end = STORE_MAGIC_SIZE;
+	uint8_t header[STORE_HEADER_SIZE];
+	std::vector<char> body;
+	while (stream.readInto(header, sizeof(header)) == sizeof(header)) {
+		const uint16_t keyLength = read16(header + 4);
+		const uint16_t flags = read16(header + 6);
+		const uint32_t length = read32(header + 8);
+		if (keyLength == 0 || keyLength > MAX_KEY || length > MAX_VALUE || flags > STORE_ERASED) {
+			break;
+		}
+
+		body.resize(keyLength + length);
+		if (stream.readInto(body.data(), body.size()) != body.size() || checksum(header, body.data(), body.size()) != read32(header)) {
+			break;
+		}
+
+		String key;
+		key.concat(body.data(), keyLength);
+		Slot *existing = find(key);
+		if (existing) {
+			live -= STORE_HEADER_SIZE + existing->keyLength + existing->length;
+		}
+
+		if (flags & STORE_ERASED) {
+			if (existing) {
+				erase(*existing);
+			}
+		} else {
+			if (existing) {
+				existing->offset = end;
+				existing->length = length;
+			} else {
+				insert({hashKey(key.c_str(), keyLength), end, length, keyLength});
+			}
+			live += STORE_HEADER_SIZE + keyLength + length;
+		}
+		end += STORE_HEADER_SIZE + keyLength + length;
+	}
+
+	if (end < stream.size()) {
+		// Rewrite the file without the broken tail, so new records don't end up after it where they'd never be read.
+		logger::warn("Dropping " + String(static_cast<unsigned long>(stream.size() - end)) + " bytes of incomplete updates from store: " + file.str());
+		stream = FileStream();
+		compact();
+		return attach();
+	}
+	return true;
+}
+
+bool Store::attach() {
+	if (log && mount == generation()) {
+		return true;
+	}
+	if (!connected()) {
+		return false;
+	}
+
+	// The file was opened on an earlier mount, which went away with the drive.
+	if (log) {
+		fclose(log);
+	}
+
+	// Opened for update rather than append, since every write is seeked to the end of the last good record anyway.
+	log = fopen(_path(file.str()).c_str(), "r+b");
+	if (!log) {
+		logger::error("Failed to open store: " + file.str());
+		return false;
+	}
+	mount = generation();
+	return true;
+}
+
+bool Store::readRecord(const Slot &slot, String *key, std::vector<uint8_t> *value) {
+	if (!attach()) {
+		return false;
+	}
+
+	std::vector<uint8_t> body(slot.keyLength + (value ? slot.length : 0));
+	if (fseek(log, slot.offset + STORE_HEADER_SIZE, SEEK_SET) != 0 || fread(body.data(), 1, body.size(), log) != body.size()) {
+		logger::error("Failed to read from store: " + file.str());
+		return false;
+	}
+
+	if (key) {
+		*key = String();
+		key->concat(reinterpret_cast<const char *>(body.data()), slot.keyLength);
+	}
+	if (value) {
+		value->assign(body.begin() + slot.keyLength, body.end());
+	}
+	return true;
+}
+
+Store::Slot *Store::find(const String &key, std::vector<uint8_t> *value) {
+	if (slots.empty()) {
+		return nullptr;
+	}
+
+	const uint32_t hash = hashKey(key.c_str(), key.length());
+	const size_t mask = slots.size() - 1;
+	for (size_t i = hash & mask; slots[i].offset; i = (i + 1) & mask) {
+		// Only the hash is kept in memory, so check the key itself on the drive before trusting a match.
+		String stored;
+		if (slots[i].hash == hash && slots[i].keyLength == key.length() && readRecord(slots[i], &stored, value) && stored == key) {
+			return &slots[i];
+		}
+	}
+	return nullptr;
+}
+
+void Store::insert(const Slot &slot) {
+	// Keep the table at most three quarters full, so probes stay short.
+	if ((count + 1) * 4 > slots.size() * 3) {
+		grow();
+	}
+
+	const size_t mask = slots.size() - 1;
+	size_t i = slot.hash & mask;
+	while (slots[i].offset) {
+		i = (i + 1) & mask;
+	}
+	slots[i] = slot;
+	count++;
+}
+
+void Store::erase(Slot &slot) {
+	// Shift later entries back into the gap, so that lookups never stop early at it.
+	const size_t mask = slots.size() - 1;
+	size_t hole = &slot - slots.data();
+	for (size_t i = (hole + 1) & mask; slots[i].offset; i = (i + 1) & mask) {
+		const size_t home = slots[i].hash & mask;
+		const bool between = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+		if (!between) {
+			slots[hole] = slots[i];
+			hole = i;
+		}
+	}
+	slots[hole].offset = 0;
+	count--;
+}
+
+void Store::grow() {
+	std::vector<Slot> old(slots.empty() ? STORE_MIN_SLOTS : slots.size() * 2, Slot{0, 0, 0, 0});
+	old.swap(slots);
+	count = 0;
+	for (const Slot &slot : old) {
+		if (slot.offset) {
+			insert(slot);
+		}
+	}
+}
+
+bool Store::append(const String &key, const void *data, size_t bytes, bool tombstone) {
+	if (key.length() == 0 || key.length() > MAX_KEY || bytes > MAX_VALUE) {
+		logger::error("Key or value is too large for store: " + key);
+		return false;
+	}
+	if (!attach()) {
+		return false;
+	}
+
+	Slot *existing = find(key);
+	if (tombstone && !existing) {
+		return false;
+	}
+
+	// Build the whole record first, so it goes to the drive in a single write.
+	std::vector<uint8_t> record(STORE_HEADER_SIZE + key.length() + bytes);
+	write16(record.data() + 4, key.length());
+	write16(record.data() + 6, tombstone ? STORE_ERASED : 0);
+	write32(record.data() + 8, bytes);
+	memcpy(record.data() + STORE_HEADER_SIZE, key.c_str(), key.length());
+	if (bytes) {
+		memcpy(record.data() + STORE_HEADER_SIZE + key.length(), data, bytes);
+	}
+	write32(record.data(), checksum(record.data(), record.data() + STORE_HEADER_SIZE, record.size() - STORE_HEADER_SIZE));
+
+	// A failed write leaves end where it was, so the next record overwrites whatever part of this one made it out.
+	file.invalidate();
+	if (fseek(log, end, SEEK_SET) != 0 || fwrite(record.data(), 1, record.size(), log) != record.size() || fflush(log) != 0) {
+		logger::error("Failed to write to store: " + file.str());
+		return false;
+	}
+
+	if (existing) {
+		live -= STORE_HEADER_SIZE + existing->keyLength + existing->length;
+	}
+	if (tombstone) {
+		erase(*existing);
+	} else {
+		if (existing) {
+			existing->offset = end;
+			existing->length = bytes;
+		} else {
+			insert({hashKey(key.c_str(), key.length()), end, static_cast<uint32_t>(bytes), static_cast<uint16_t>(key.length())});
+		}
+		live += record.size();
+	}
+	end += record.size();
+
+	const uint32_t stale = end - STORE_MAGIC_SIZE - live;
+	if (stale > STORE_COMPACT_MIN && stale > live) {
+		compact();
+	}
+	return true;
+}
+
+bool Store::good() const {
+	return log != nullptr;
+}
+
+size_t Store::size() const {
+	return count;
+}
+
+bool Store::contains(const String &key) {
+	return find(key) != nullptr;
+}
+
+bool Store::get(const String &key, std::vector<uint8_t> &value) {
+	return find(key, &value) != nullptr;
+}
+
+bool Store::get(const String &key, String &value) {
+	std::vector<uint8_t> data;
+	if (!get(key, data)) {
+		return false;
+	}
+
+	value = String();
+	value.concat(reinterpret_cast<const char *>(data.data()), data.size());
+	return true;
+}
+
+bool Store::put(const String &key, const void *data, size_t bytes) {
+	return append(key, data, bytes, false);
+}
+
+bool Store::put(const String &key, const std::vector<uint8_t> &value) {
+	return append(key, value.data(), value.size(), false);
+}
+
+bool Store::put(const String &key, const String &value) {
+	return append(key, value.c_str(), value.length(), false);
+}
+
+bool Store::remove(const String &key) {
+	return append(key, nullptr, 0, true);
+}
+
+bool Store::compact() {
+	if (!attach()) {
+		return false;
+	}
+
+	// Copy the latest record for each key into a new file, then swap it in.
+	const Path partial(file.str() + STORE_COMPACT_EXT);
+	FileWriter writer = partial.writer();
+	if (!writer || !writer.write(STORE_MAGIC, STORE_MAGIC_SIZE)) {
+		return false;
+	}
+
+	std::vector<Slot> moved(slots);
+	std::vector<uint8_t> record;
+	uint32_t offset = STORE_MAGIC_SIZE;
+	for (Slot &slot : moved) {
+		if (!slot.offset) {
+			continue;
+		}
+
+		record.resize(STORE_HEADER_SIZE + slot.keyLength + slot.length);
+		if (fseek(log, slot.offset, SEEK_SET) != 0 || fread(record.data(), 1, record.size(), log) != record.size() || !writer.write(record)) {
+			logger::error("Failed to compact store: " + file.str());
+			writer.close();
+			partial.unlink();
+			return false;
+		}
+		slot.offset = offset;
+		offset += record.size();
+	}
+
+	if (!writer.close()) {
+		logger::error("Failed to compact store: " + file.str());
+		partial.unlink();
+		return false;
+	}
+
+	// If this is interrupted after the old file has been removed, load() finishes the rename.
+	fclose(log);
+	log = nullptr;
+	if (!partial.rename(file, true)) {
+		logger::error("Failed to replace store with compacted file: " + file.str());
+		attach();
+		return false;
+	}
+
+	slots.swap(moved);
+	end = offset;
+	live = offset - STORE_MAGIC_SIZE;
+	return attach();
+}
+
+} // namespace fs
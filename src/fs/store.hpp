@@ -0,0 +1,157 @@
+/// @file store.hpp
+#pragma once
+
+#include "../fs.hpp"
+#include <vector>
+
+namespace fs {
+
+/**
+ * @brief A small key-value store in a single file, for settings and cache metadata.
+ *
+ * Rewriting a whole JSON file to change one value means rewriting every other value with it. Instead, the store
+ * is a log: every put() or remove() appends one record to the end of the file, so an update costs one small write.
+ * The position of the latest record for each key is kept in a hash table in RAM (16 bytes per key),
+ * so lookups read exactly one record, and values themselves are never held in memory.
+ *
+ * Each record carries a CRC-32 of its contents. If the drive is pulled or the power fails part way through an append,
+ * the torn record fails its check when the store is next opened, and is dropped along with anything after it,
+ * leaving the store as it was before the interrupted update.
+ *
+ * Old versions of a key stay in the file until it is compacted, i.e. rewritten with only the latest records.
+ * This happens automatically once more than half of the file is out of date, or can be done with compact().
+ * Compaction writes a new file and renames it into place, so a crash part way through leaves the old one intact.
+ *
+ * If the USB drive is remounted (see fs::poll()), the file is opened again on the next access.
+ */
+class Store {
+public:
+	/// The longest key that can be stored, in bytes.
+	static constexpr size_t MAX_KEY = 255;
+	/// The largest value that can be stored, in bytes.
+	static constexpr size_t MAX_VALUE = 65535;
+
+private:
+	/// Where the latest record for a key is in the file. A slot with offset 0 is empty, since the file starts with its header.
+	struct Slot {
+		uint32_t hash;
+		uint32_t offset;
+		uint32_t length;
+		uint16_t keyLength;
+	};
+
+	Path file;
+	FILE *log;
+	unsigned long mount;
+	std::vector<Slot> slots;
+	size_t count;
+	uint32_t end;
+	uint32_t live;
+
+	bool load();
+	bool attach();
+	bool append(const String &key, const void *data, size_t bytes, bool tombstone);
+	bool readRecord(const Slot &slot, String *key, std::vector<uint8_t> *value);
+	Slot *find(const String &key, std::vector<uint8_t> *value = nullptr);
+	void insert(const Slot &slot);
+	void erase(Slot &slot);
+	void grow();
+
+public:
+	/**
+	 * @brief Constructor for the Store class. This reads through the file to build the index.
+	 * @param file The file to keep the store in. It is created if it does not exist.
+	 */
+	Store(const Path &file);
+
+	/// Destructor. This closes the file. Every update is already on the drive.
+	~Store();
+
+	Store(const Store &) = delete;
+	Store &operator=(const Store &) = delete;
+
+	/**
+	 * @brief Check if the store was opened successfully.
+	 * @return True if the store can be used, false otherwise.
+	 */
+	bool good() const;
+
+	/**
+	 * @brief Check if the store was opened successfully.
+	 * @return True if the store can be used, false otherwise.
+	 */
+	inline operator bool() const {
+		return good();
+	}
+
+	/**
+	 * @brief Get the number of keys in the store.
+	 * @return The number of keys.
+	 */
+	size_t size() const;
+
+	/**
+	 * @brief Check if a key is in the store.
+	 * @param key The key to look up.
+	 * @return True if the key has a value, false otherwise.
+	 * @note Only hashes are kept in memory, so a match is confirmed by reading the key from the drive.
+	 */
+	bool contains(const String &key);
+
+	/**
+	 * @brief Read the value stored for a key.
+	 * @param key The key to look up.
+	 * @param value Set to the value, if there is one.
+	 * @return True if the key was found, false otherwise.
+	 */
+	bool get(const String &key, std::vector<uint8_t> &value);
+
+	/**
+	 * @brief Read the value stored for a key as a string.
+	 * @param key The key to look up.
+	 * @param value Set to the value, if there is one.
+	 * @return True if the key was found, false otherwise.
+	 */
+	bool get(const String &key, String &value);
+
+	/**
+	 * @brief Store a value for a key, replacing any value it already has.
+	 * The record is on the drive when this returns.
+	 * @param key The key to store the value under. At most MAX_KEY bytes.
+	 * @param data The value to store.
+	 * @param bytes The length of the value in bytes. At most MAX_VALUE.
+	 * @return True if the value was stored, false otherwise.
+	 */
+	bool put(const String &key, const void *data, size_t bytes);
+
+	/**
+	 * @brief Store a value for a key, replacing any value it already has.
+	 * @param key The key to store the value under.
+	 * @param value The value to store.
+	 * @return True if the value was stored, false otherwise.
+	 */
+	bool put(const String &key, const std::vector<uint8_t> &value);
+
+	/**
+	 * @brief Store a string for a key, replacing any value it already has.
+	 * @param key The key to store the value under.
+	 * @param value The value to store.
+	 * @return True if the value was stored, false otherwise.
+	 */
+	bool put(const String &key, const String &value);
+
+	/**
+	 * @brief Remove a key from the store.
+	 * @param key The key to remove.
+	 * @return True if the key was removed, false if it was not in the store or the removal could not be written.
+	 */
+	bool remove(const String &key);
+
+	/**
+	 * @brief Rewrite the file with only the latest value for each key.
+	 * @return True if the file was rewritten, false otherwise. The store is unchanged if this fails.
+	 */
+	bool compact();
+};
+
+} // namespace fs
@@ -0,0 +1,166 @@
+#include "writeBehind.hpp"
+#include "../fs.hpp"
+
+// The stack size of the worker thread. Writes go through the FAT and USB mass storage layers, which need a few KB.
+#define WRITE_BEHIND_STACK_SIZE 4096
+
+// The number of empty buffers kept for reuse, on top of one for each queue slot. This covers the writers filling them.
+#define WRITE_BEHIND_SPARES 4
+
+namespace fs {
+
+constexpr size_t WriteBehind::DEFAULT_DEPTH;
+
+#ifdef EMULATE
+WriteBehind::WriteBehind(size_t bufferSize, size_t depth) : depth(depth ? depth : 1), head(0), count(0), spares(0), stopping(false) {
+#else
+WriteBehind::WriteBehind(size_t bufferSize, size_t depth) : depth(depth ? depth : 1), head(0), count(0), spares(0), stopping(false), changed(mutex), thread(osPriorityNormal, WRITE_BEHIND_STACK_SIZE, nullptr, "writeBehind") {
+#endif
+	const size_t alignment = clusterSize() ? clusterSize() : 1;
+	this->bufferSize = (bufferSize + alignment - 1) / alignment * alignment;
+	if (!this->bufferSize) {
+		this->bufferSize = alignment;
+	}
+
+	jobs = new Job[this->depth];
+	spare = new uint8_t *[this->depth + WRITE_BEHIND_SPARES];
+
+#ifdef EMULATE
+	thread = std::thread(&WriteBehind::run, this);
+#else
+	thread.start(mbed::callback(this, &WriteBehind::run));
+#endif
+}
+
+WriteBehind::~WriteBehind() {
+	mutex.lock();
+	stopping = true;
+	notify();
+	mutex.unlock();
+
+	thread.join();
+
+	for (size_t i = 0; i < spares; i++) {
+		delete[] spare[i];
+	}
+	delete[] spare;
+	delete[] jobs;
+}
+
+void WriteBehind::wait() {
+#ifdef EMULATE
+	changed.wait(mutex);
+#else
+	changed.wait();
+#endif
+}
+
+void WriteBehind::notify() {
+	changed.notify_all();
+}
+
+void WriteBehind::run() {
+	mutex.lock();
+	while (true) {
+		// Keep going until the queue is empty, even when stopping, so nothing queued is lost.
+		while (!count && !stopping) {
+			wait();
+		}
+		if (!count) {
+			break;
+		}
+
+		// Leave the job in the queue while it's written, so its slot isn't reused until it's done.
+		const Job job = jobs[head];
+		mutex.unlock();
+
+		size_t written = fwrite(job.data, 1, job.length, job.target->file);
+		if (written == job.length && fflush(job.target->file) != 0) {
+			written = 0;
+		}
+
+		mutex.lock();
+		job.target->completed += written;
+		job.target->failed = job.target->failed || written != job.length;
+		job.target->outstanding--;
+		head = (head + 1) % depth;
+		count--;
+		if (spares < depth + WRITE_BEHIND_SPARES) {
+			spare[spares++] = job.data;
+		} else {
+			delete[] job.data;
+		}
+		notify();
+	}
+	mutex.unlock();
+}
+
+size_t WriteBehind::size() const {
+	return bufferSize;
+}
+
+bool WriteBehind::ready() {
+	mutex.lock();
+	const bool room = count < depth;
+	mutex.unlock();
+	return room;
+}
+
+uint8_t *WriteBehind::acquire() {
+	mutex.lock();
+	uint8_t *buffer = spares ? spare[--spares] : nullptr;
+	mutex.unlock();
+
+	if (!buffer) {
+		buffer = new uint8_t[bufferSize];
+	}
+	return buffer;
+}
+
+void WriteBehind::release(uint8_t *buffer) {
+	mutex.lock();
+	if (spares < depth + WRITE_BEHIND_SPARES) {
+		spare[spares++] = buffer;
+		buffer = nullptr;
+	}
+	mutex.unlock();
+
+	delete[] buffer;
+}
+
+void WriteBehind::submit(Target &target, uint8_t *buffer, size_t length) {
+	mutex.lock();
+	while (count == depth) {
+		wait();
+	}
+
+	jobs[(head + count) % depth] = {&target, buffer, length};
+	count++;
+	target.outstanding++;
+	notify();
+	mutex.unlock();
+}
+
+bool WriteBehind::busy(Target &target) {
+	mutex.lock();
+	const bool outstanding = target.outstanding != 0;
+	mutex.unlock();
+	return outstanding;
+}
+
+void WriteBehind::drain(Target &target) {
+	mutex.lock();
+	while (target.outstanding) {
+		wait();
+	}
+	mutex.unlock();
+}
+
+WriteBehind::Target WriteBehind::progress(Target &target) {
+	mutex.lock();
+	const Target copy = target;
+	mutex.unlock();
+	return copy;
+}
+
+} // namespace fs
@@ -0,0 +1,150 @@
+/// @file writeBehind.hpp
+#pragma once
+
+#include <Arduino.h>
+
+#ifdef EMULATE
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#else
+#include <Arduino_USBHostMbed5.h>
+#include <mbed.h>
+#endif
+
+namespace fs {
+
+/**
+ * @brief A background thread that writes full buffers to files, so the caller never waits on the USB drive.
+ *
+ * A flash drive can take tens of milliseconds to program a page. When that happens inline, the main loop stalls,
+ * the network stops being read and the TCP window closes. Instead, a FileWriter given a WriteBehind hands each
+ * full buffer to it and carries on filling a fresh one, while the worker writes the full one out.
+ *
+ * At most `depth` buffers can be waiting at once. When the queue is full, ready() is false, and callers should stop
+ * reading more data (e.g. from the network) until it drains. If they don't, the next full buffer waits for a slot.
+ * Buffers are recycled, so after the first few writes no memory is allocated.
+ *
+ * The worker runs on a std::thread when emulating, and an RTOS thread on the board.
+ * It runs at the same priority as the main loop, so they share the CPU while both have work to do.
+ */
+class WriteBehind {
+public:
+	/// The default number of full buffers that can be waiting to be written.
+	static constexpr size_t DEFAULT_DEPTH = 4;
+
+	/**
+	 * @brief The progress of one file's writes, shared between its FileWriter and the worker.
+	 */
+	struct Target {
+		/// The file to write to.
+		FILE *file;
+		/// The number of bytes written to the file so far.
+		uint64_t completed;
+		/// The number of buffers waiting to be written.
+		size_t outstanding;
+		/// Whether any write has failed.
+		bool failed;
+	};
+
+private:
+	/// A full buffer waiting to be written.
+	struct Job {
+		Target *target;
+		uint8_t *data;
+		size_t length;
+	};
+
+	size_t bufferSize;
+	size_t depth;
+	Job *jobs;
+	size_t head;
+	size_t count;
+	uint8_t **spare;
+	size_t spares;
+	bool stopping;
+
+#ifdef EMULATE
+	std::mutex mutex;
+	std::condition_variable_any changed;
+	std::thread thread;
+#else
+	rtos::Mutex mutex;
+	rtos::ConditionVariable changed;
+	rtos::Thread thread;
+#endif
+
+	void run();
+	void wait();
+	void notify();
+
+public:
+	/**
+	 * @brief Constructor for the WriteBehind class. This starts the worker thread.
+	 * @param bufferSize The size of each buffer in bytes. This is rounded up to a whole number of clusters.
+	 * @param depth The number of full buffers that can be waiting to be written.
+	 */
+	WriteBehind(size_t bufferSize, size_t depth = DEFAULT_DEPTH);
+
+	/// Destructor. Everything still queued is written before the worker stops.
+	~WriteBehind();
+
+	WriteBehind(const WriteBehind &) = delete;
+	WriteBehind &operator=(const WriteBehind &) = delete;
+
+	/**
+	 * @brief Get the size of the buffers handed out by acquire().
+	 * @return The buffer size in bytes.
+	 */
+	size_t size() const;
+
+	/**
+	 * @brief Check if there is room in the queue for another full buffer.
+	 * @return True if submit() would not wait, false otherwise.
+	 */
+	bool ready();
+
+	/**
+	 * @brief Get an empty buffer to fill, reusing one that has already been written if possible.
+	 * @return A buffer of size() bytes. It belongs to the caller until it is passed to submit() or release().
+	 */
+	uint8_t *acquire();
+
+	/**
+	 * @brief Give an unused buffer back.
+	 * @param buffer A buffer from acquire().
+	 */
+	void release(uint8_t *buffer);
+
+	/**
+	 * @brief Queue a buffer to be written to the end of a file. The worker takes ownership of the buffer.
+	 * If the queue is full, this waits until there is room.
+	 * @param target The file to write to.
+	 * @param buffer A buffer from acquire().
+	 * @param length The number of bytes in the buffer to write.
+	 */
+	void submit(Target &target, uint8_t *buffer, size_t length);
+
+	/**
+	 * @brief Check if a file still has buffers waiting to be written.
+	 * @param target The file to check.
+	 * @return True if the worker still has data for the file, false otherwise.
+	 */
+	bool busy(Target &target);
+
+	/**
+	 * @brief Wait until everything queued for a file has been written.
+	 * @param target The file to wait for.
+	 */
+	void drain(Target &target);
+
+	/**
+	 * @brief Read a file's progress, consistently with the worker.
+	 * @param target The file to check.
+	 * @return A copy of the file's progress.
+	 */
+	Target progress(Target &target);
+};
+
+} // namespace fs
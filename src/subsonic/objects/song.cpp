@@ -33,6 +33,8 @@ optional<Song> jsonDecode(const JsonDocument &document, const Client *client) {
 		json_optional_key_to(int, document, "year"),
 		json_optional_key_to(int, document, "discNumber"),
 		json_optional_key_to(int, document, "averageRating"),
+		json_contains_key(document, "replayGain") ? json_optional_key_to(float, document["replayGain"], "trackGain") : optional<float>{},
+		json_contains_key(document, "replayGain") ? json_optional_key_to(float, document["replayGain"], "trackPeak") : optional<float>{},
 	});
 }
 
@@ -68,6 +68,12 @@ struct Song {
 	/// @brief The average rating of this song, if any.
 	optional<int> averageRating;
 
+	/// @brief The ReplayGain track gain in dB, if the server provides it (OpenSubsonic).
+	optional<float> replayGain;
+
+	/// @brief The ReplayGain track peak, where 1.0 is full scale, if the server provides it (OpenSubsonic).
+	optional<float> replayGainPeak;
+
 	// String uri() const;
 };
 
@@ -3,8 +3,19 @@
 
 #define REDIRECT_LIMIT 5
 
+// How long data can sit in a download's write buffer before it is flushed to the file anyway.
+#define FLUSH_INTERVAL_MS 250
+
+// The suffix added to a download's destination while it is in progress.
+#define PARTIAL_SUFFIX ".part"
+
+// The number of cleaned up downloads whose outcome is remembered for readers that haven't caught up yet.
+#define OUTCOME_HISTORY 32
+
 namespace util {
 
+DownloadQueue::DownloadQueue() : worker(fs::FileWriter::DEFAULT_BUFFER) {}
+
 DownloadQueue::~DownloadQueue() {
 	for (auto &download : downloads) {
 		delete download; // Clean up allocated memory for each download
@@ -13,12 +24,15 @@ DownloadQueue::~DownloadQueue() {
 
 int DownloadQueue::download(const fs::Path &file, const String &url) {
 	int id = uid();
-	// Make sure that the file is deleted before starting the download
-	// otherwise we would just append garbage data onto some file
-	if (file.exists()) {
-		file.unlink();
+	// Opening the writer truncates any leftover partial file, otherwise we would just append garbage data onto it.
+	// The file is created up front so it can be read while the download is in progress.
+	const fs::Path partial(file.str() + PARTIAL_SUFFIX);
+	auto dl = new Download{file, partial, net::get(url), id, partial.writer(false, &worker), 0, false, false, millis(), {}, 0};
+
+	const uint64_t length = dl->request.length();
+	if (length && length != (uint64_t)-1) {
+		dl->writer.preallocate(length);
 	}
-	auto dl = new Download{file, net::get(url), id};
 
 	downloads.push_back(dl);
 	return id;
@@ -27,23 +41,95 @@ int DownloadQueue::download(const fs::Path &file, const String &url) {
 bool DownloadQueue::finished(int id) const {
 	for (const auto download : downloads) {
 		if (download && download->id == id) {
-			return download->request.done();
+			return download->complete;
 		}
 	}
 	return false;
 }
 
+const Download *DownloadQueue::get(int id) const {
+	for (const auto download : downloads) {
+		if (download && download->id == id) {
+			return download;
+		}
+	}
+	return nullptr;
+}
+
+const DownloadOutcome *DownloadQueue::outcome(int id) const {
+	for (const auto &outcome : outcomes) {
+		if (outcome.id == id) {
+			return &outcome;
+		}
+	}
+	return nullptr;
+}
+
+void DownloadQueue::finish(Download &download) {
+	bool success = download.writer.close();
+	download.written = download.writer.written();
+	download.complete = true;
+
+	const uint64_t length = download.request.length();
+	if (!download.request.ok() || (length && length != (uint64_t)-1 && download.written != length)) {
+		success = false;
+	}
+
+	if (success) {
+		// Replace any older copy.
+		success = download.partial.rename(download.file, true);
+	}
+
+	download.succeeded = success;
+	if (!success) {
+		logger::error("Download failed: " + download.file.str());
+		download.partial.unlink();
+	}
+}
+
 void DownloadQueue::process() {
 	for (auto download : downloads) {
-		if (download && download->request.ready()) {
-			download->file.write(download->request.stream(), true);
+		if (!download || download->complete) {
+			continue;
+		}
+
+		// Only take what the worker has room for, keeping the rest for later, and only read more from the network
+		// once everything already read has been taken. The main loop never waits on the drive.
+		if (download->backlogOffset < download->backlog.size()) {
+			download->backlogOffset += download->writer.writeSome(download->backlog.data() + download->backlogOffset, download->backlog.size() - download->backlogOffset);
+		}
+		if (download->backlogOffset == download->backlog.size() && download->writer.ready() && download->request.ready()) {
+			download->backlog = download->request.stream();
+			download->backlogOffset = download->writer.writeSome(download->backlog.data(), download->backlog.size());
+		}
+		const bool drained = download->backlogOffset == download->backlog.size();
+
+		// Don't let readers wait too long for a full cluster if the data is arriving slowly.
+		if (download->writer.pending() && download->writer.ready() && millis() - download->writtenAt >= FLUSH_INTERVAL_MS) {
+			download->writer.flush();
+		}
+
+		if (download->writer.written() != download->written) {
+			download->written = download->writer.written();
+			download->writtenAt = millis();
+		}
+
+		if (drained && download->request.done() && !download->request.ready()) {
+			// Hand over the last of the data once there's room, then wait for the worker to write it without blocking.
+			if (download->writer.pending() && download->writer.ready()) {
+				download->writer.flush();
+			}
+			if (!download->writer.pending() && !download->writer.busy()) {
+				finish(*download);
+			}
 		}
 	}
 }
 
 void DownloadQueue::cleanup() {
 	for (auto &download : downloads) {
-		if (download && download->request.done()) {
+		if (download && download->complete) {
+			outcomes.push_back({download->id, download->succeeded, download->written});
 			delete download;
 			download = nullptr;
 		}
@@ -51,6 +137,10 @@ void DownloadQueue::cleanup() {
 
 	auto condition = std::remove_if(downloads.begin(), downloads.end(), [](const Download *download) { return !download; });
 	downloads.erase(condition, downloads.end());
+
+	if (outcomes.size() > OUTCOME_HISTORY) {
+		outcomes.erase(outcomes.begin(), outcomes.end() - OUTCOME_HISTORY);
+	}
 }
 
 } // namespace util
@@ -10,12 +10,40 @@ namespace util {
  * @brief A struct representing a download.
  */
 struct Download {
-	/// The destination file path.
+	/// The destination file path. This only exists once the download has completed successfully.
 	fs::Path file;
+	/// The path the download is written to until it completes, i.e. the destination with `.part` appended.
+	fs::Path partial;
 	/// The network request associated with the download.
 	net::Request request;
 	/// The unique identifier for the download.
 	int id;
+	/// The open writer for the destination file, which hands full buffers to the queue's worker.
+	fs::FileWriter writer;
+	/// The number of bytes written to the file so far, and visible to readers.
+	uint64_t written;
+	/// Whether the request has finished, and the file has either been renamed to its destination or removed.
+	bool complete;
+	/// Whether the download completed and was renamed to its destination.
+	bool succeeded;
+	/// When data was last written to the file, in milliseconds.
+	unsigned long writtenAt;
+	/// Data read from the network that the writer couldn't take yet, because the worker's queue was full.
+	std::vector<uint8_t> backlog;
+	/// How much of the backlog the writer has taken so far.
+	size_t backlogOffset;
+};
+
+/**
+ * @brief How a download ended, kept for a while after it has been cleaned up from the queue.
+ */
+struct DownloadOutcome {
+	/// The unique identifier for the download.
+	int id;
+	/// Whether the download completed and was renamed to its destination.
+	bool succeeded;
+	/// The number of bytes written to the file.
+	uint64_t written;
 };
 
 /**
@@ -59,11 +87,27 @@ public:
 
 /**
  * @brief A class for managing a queue of downloads.
+ *
+ * Each download is written to a `.part` file next to its destination, preallocated to the full size when the server
+ * sends a Content-Length, so the file's clusters are allocated contiguously. Once every byte has arrived,
+ * it is renamed to the destination, so a file at the destination is always complete.
+ * Failed downloads are removed.
+ *
+ * Data is written to the drive by a background worker, so a slow flash write never holds up reading the network
+ * (or the rest of the main loop). If the drive falls behind, each download keeps what it has already read,
+ * and leaves the rest with the network until the worker catches up. process() never waits for the worker.
  */
 class DownloadQueue {
 	std::vector<Download *> downloads;
+	std::vector<DownloadOutcome> outcomes;
+	fs::WriteBehind worker;
+
+	void finish(Download &download);
 
 public:
+	/// Constructor. This starts the worker that writes downloads to the drive.
+	DownloadQueue();
+
 	/// Destructor.
 	~DownloadQueue();
 
@@ -78,18 +122,37 @@ public:
 	/**
 	 * @brief Check if a download is finished.
 	 * @param id The unique identifier for the download.
-	 * @return True if the download is finished, false otherwise.
+	 * @return True if the download is finished and either renamed to its destination or removed, false otherwise.
 	 */
 	bool finished(int id) const;
 
+	/**
+	 * @brief Look up a download that is still in the queue.
+	 * @param id The unique identifier for the download.
+	 * @return A pointer to the download, or nullptr if it has been cleaned up (or never existed).
+	 */
+	const Download *get(int id) const;
+
+	/**
+	 * @brief Look up how a download ended, once it has been cleaned up from the queue.
+	 * Readers that were still playing a download when it was cleaned up can find out how much of the file to trust.
+	 * @param id The unique identifier for the download.
+	 * @return A pointer to the outcome, or nullptr if the download is still in the queue or ended too long ago.
+	 * @note Only the most recently cleaned up downloads are remembered, so the pointer is only valid until the next cleanup().
+	 */
+	const DownloadOutcome *outcome(int id) const;
+
 	/**
 	 * @brief Process the download queue, appending an available data to the relevant files.
+	 * Data is buffered and written in cluster-sized pieces, but anything left in the buffer for too long is flushed,
+	 * so readers of a slow download are never left waiting on the buffer to fill.
+	 * A download finishes once the worker has written all of its data.
 	 * @note This does not remove finished downloads from the queue.
 	 */
 	void process();
 
 	/**
-	 * @brief Clean up finished downloads.
+	 * @brief Clean up finished downloads. How each one ended can still be found with outcome().
 	 */
 	void cleanup();
 
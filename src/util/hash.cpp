@@ -0,0 +1,37 @@
+#include "hash.hpp"
+
+uint32_t fnv1a32(const void *data, size_t length) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+uint64_t fnv1a64(const void *data, size_t length) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+uint32_t mix32(uint32_t hash) {
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+uint64_t mix64(uint64_t hash) {
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
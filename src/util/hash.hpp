@@ -0,0 +1,38 @@
+/// @file hash.hpp
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Hash bytes with 32-bit FNV-1a.
+ * This is quick and stable across builds and platforms, so it can name files, but bytes near the end of the input
+ * only reach the low bits. Pass the result through mix32() before using its high bits.
+ * @param data The bytes to hash.
+ * @param length The number of bytes.
+ * @return The hash.
+ */
+uint32_t fnv1a32(const void *data, size_t length);
+
+/**
+ * @brief Hash bytes with 64-bit FNV-1a.
+ * @param data The bytes to hash.
+ * @param length The number of bytes.
+ * @return The hash. As with fnv1a32(), pass it through mix64() before using its high bits.
+ */
+uint64_t fnv1a64(const void *data, size_t length);
+
+/**
+ * @brief Spread every bit of a 32-bit hash over all of the others, with the MurmurHash3 finalizer.
+ * Keys that differ only in their last few characters (like sequential IDs) otherwise stay clustered.
+ * @param hash The hash to mix.
+ * @return The mixed hash.
+ */
+uint32_t mix32(uint32_t hash);
+
+/**
+ * @brief Spread every bit of a 64-bit hash over all of the others, with the MurmurHash3 finalizer.
+ * @param hash The hash to mix.
+ * @return The mixed hash.
+ */
+uint64_t mix64(uint64_t hash);
@@ -1,5 +1,6 @@
 // #include "src/audio.hpp"
 // #include "src/callback.hpp"
+#include "src/bench.hpp"
 #include "src/emulation_helpers.hpp"
 #include "src/fs.hpp"
 #include "src/net.hpp"
@@ -13,6 +14,12 @@ void setup() {
 	pins::init();
 
 	fs::connect();			// Ensure filesystem is connected
+
+#if defined(EMULATE) && defined(BENCHMARK)
+	bench::run();
+	exit(0);
+#endif
+
 	request::netInit(); // Initialize network connection
 
 	while (!net::connected()) {
@@ -80,6 +87,8 @@ void setup() {
 }
 
 void loop() {
+	fs::poll(); // Remount the drive if it dropped out
+
 #ifdef EMULATE
 	exit(0);
 #endif